@@ -2,6 +2,9 @@
 
 precision mediump float;
 
+// Должно совпадать с MAX_CLIP_PLANES в src/splitter_planes.h
+#define MAX_PLANES 16
+
 varying vec2 fragTexCoord;
 varying vec4 fragColor;
 
@@ -9,21 +12,42 @@ varying vec4 fragColor;
 //uniform vec2 displacement;
 
 uniform sampler2D texture0;
-uniform sampler2D mask_texture;
+
+// Размер глифа в пикселях
+uniform vec2 glyph_size;
+// Область глифа на странице атласа: xy - угол, zw - размер. w < 0 у
+// страниц из render texture
+uniform vec4 uv_rect;
+// Страница хранит поле расстояний со знаком, 0.5 на границе глифа
+uniform int sdf;
+// Полуширина сглаживания границы в единицах поля
+uniform float smoothing;
+uniform int planes_num;
+// xy - нормаль, z - расстояние. Система координат глифа: центр текстуры,
+// y вниз. Точка отсекается, если dot(n, p) - dist >= 0.
+uniform vec3 planes[MAX_PLANES];
 
 void main()
 {
     vec2 uv = fragTexCoord;
 
     vec4 col = texture2D(texture0, uv).rgba;
-    vec4 stencil_col = texture2D(mask_texture, uv).rgba;
-
-    if (stencil_col.r > 0.5 &&
-        stencil_col.g > 0.5 &&
-        stencil_col.g > 0.5)
-        col.a = 0.;
+    if (sdf != 0) {
+        float a = smoothstep(0.5 - smoothing, 0.5 + smoothing, col.r);
+        col = vec4(fragColor.rgb, a * fragColor.a);
+    }
+
+    // Render texture выбирается перевернутой по y, это учтено в знаке uv_rect.w
+    vec2 local = (uv - uv_rect.xy) / uv_rect.zw;
+    vec2 p = (local - 0.5) * glyph_size;
+
+    for (int i = 0; i < MAX_PLANES; i++) {
+        if (i >= planes_num)
+            break;
+        if (dot(planes[i].xy, p) - planes[i].z >= 0.)
+            col.a = 0.;
+    }
 
     gl_FragColor = col;
     //gl_FragColor = vec4(uv.x, uv.y, 1., 1.);
 }
-
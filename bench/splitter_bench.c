@@ -0,0 +1,1209 @@
+// Headless бенчмарк разрезания. Окно и GL контекст не создаются.
+//
+// ./splitter_bench [scene|all|swipe|pool|budget|lod|bake|clip|threads|hasty|
+//                   broadphase|clock|sdf|snapshot|raster] [slices]
+// ./splitter_bench replay FILE [timing.csv]
+// ./splitter_bench replay_check
+// ./splitter_bench slice_check
+
+#include "chipmunk/chipmunk.h"
+#include "koh_destral_ecs.h"
+#include "koh_logger.h"
+#include "splitter_clip.h"
+#include "splitter_core.h"
+#include "splitter_log.h"
+#include "splitter_planes.h"
+#include "splitter_raster.h"
+#include "splitter_replay.h"
+#include "splitter_snapshot.h"
+#include "splitter_sdf.h"
+#include "splitter_workers.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_W     1920.
+#define ARENA_H     1000.
+#define GLYPH_W     270.
+#define GLYPH_H     455.
+
+struct Samples {
+    double  *arr;
+    int     num, cap;
+};
+
+struct BenchCtx {
+    struct Samples  poststep;
+    uint64_t        rng;
+};
+
+struct Scene {
+    const char  *name;
+    bool        gravity;
+    void        (*setup)(SplitterCore *core, struct BenchCtx *ctx);
+    void        (*next_slice)(
+        SplitterCore *core, struct BenchCtx *ctx, cpVect *from, cpVect *to
+    );
+};
+
+static void samples_push(struct Samples *s, double value) {
+    if (s->num == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 1024;
+        s->arr = realloc(s->arr, sizeof(s->arr[0]) * s->cap);
+        assert(s->arr);
+    }
+    s->arr[s->num++] = value;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double samples_percentile(struct Samples *s, double p) {
+    if (!s->num)
+        return 0.;
+    int i = (int)(p * (s->num - 1));
+    return s->arr[i];
+}
+
+static uint64_t rng_next(struct BenchCtx *ctx) {
+    // xorshift64*
+    uint64_t x = ctx->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    ctx->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double rng_float(struct BenchCtx *ctx, double min, double max) {
+    return min + (max - min) * ((rng_next(ctx) >> 11) * (1. / 9007199254740992.));
+}
+
+static void on_poststep(SplitterCore *core, double seconds) {
+    struct BenchCtx *ctx = core->udata;
+    samples_push(&ctx->poststep, seconds);
+}
+
+// Прямая через случайную точку внутри прямоугольника под случайным углом.
+static void random_line(
+    struct BenchCtx *ctx, cpBB bb, cpVect *from, cpVect *to
+) {
+    cpVect p = {
+        rng_float(ctx, bb.l, bb.r),
+        rng_float(ctx, bb.b, bb.t),
+    };
+    cpVect dir = cpvforangle(rng_float(ctx, 0., 2. * CP_PI));
+    const double len = 2. * (ARENA_W + ARENA_H);
+    *from = cpvsub(p, cpvmult(dir, len));
+    *to = cpvadd(p, cpvmult(dir, len));
+}
+
+// Настройки ядра, которые сравниваются между прогонами одной сцены.
+// Нули - значения core_init().
+struct RunOpts {
+    bool                    nopool;
+    struct FragmentBudget   budget;
+    cpFloat                 lod_area;
+    bool                    bake;
+    // Потоки разрезания и решателя физики
+    int                     threads, step_threads;
+    enum BroadphaseType     broadphase;
+    bool                    gravity, walls;
+};
+
+#define BENCH_GRAVITY   ((cpVect) { 0, 9.8 * 20. })
+
+// Общий запуск ядра для всех режимов, сцена добавляется после
+static void bench_core_init(SplitterCore *core, struct RunOpts opts) {
+    memset(core, 0, sizeof(*core));
+    core_init(core);
+    core->pool.enabled = !opts.nopool;
+    core->budget = opts.budget;
+    core->lod.min_area = opts.lod_area;
+    core->bake.enabled = opts.bake;
+    core->broadphase.type = opts.broadphase;
+    if (opts.threads)
+        core_set_slice_threads(core, opts.threads);
+    // 0 для cpHastySpace - по числу ядер, поэтому только по запросу
+    if (opts.step_threads)
+        core_set_step_threads(core, opts.step_threads);
+    if (opts.gravity)
+        cpSpaceSetGravity(core->space, BENCH_GRAVITY);
+    if (opts.walls)
+        core_create_floor_and_walls(core);
+}
+
+static void setup_grid(SplitterCore *core, struct BenchCtx *ctx) {
+    for (int y = 0; y < 2; y++)
+        for (int x = 0; x < 6; x++) {
+            cpVect center = {
+                200. + x * (GLYPH_W + 20.),
+                -400. + y * (GLYPH_H + 20.),
+            };
+            core_create_box(core, center, (cpVect) { GLYPH_W, GLYPH_H });
+        }
+}
+
+static void slice_grid(
+    SplitterCore *core, struct BenchCtx *ctx, cpVect *from, cpVect *to
+) {
+    random_line(ctx, cpBBNew(100., -640., 1800., 300.), from, to);
+}
+
+static void setup_shatter(SplitterCore *core, struct BenchCtx *ctx) {
+    core_create_box(
+        core, (cpVect) { ARENA_W / 2., 0. }, (cpVect) { GLYPH_W, GLYPH_H }
+    );
+}
+
+static void slice_shatter(
+    SplitterCore *core, struct BenchCtx *ctx, cpVect *from, cpVect *to
+) {
+    random_line(ctx, cpBBNew(
+        ARENA_W / 2. - GLYPH_W / 4., -GLYPH_H / 4.,
+        ARENA_W / 2. + GLYPH_W / 4., GLYPH_H / 4.
+    ), from, to);
+}
+
+static void setup_pile(SplitterCore *core, struct BenchCtx *ctx) {
+    core_create_floor_and_walls(core);
+    for (int i = 0; i < 12; i++) {
+        cpVect center = {
+            rng_float(ctx, 300., ARENA_W - 300.),
+            -i * GLYPH_H,
+        };
+        core_create_box(core, center, (cpVect) { GLYPH_W, GLYPH_H });
+    }
+    // Дать телам упасть на пол.
+    for (int i = 0; i < 240; i++)
+        core_step(core, 1. / 60);
+}
+
+static void slice_pile(
+    SplitterCore *core, struct BenchCtx *ctx, cpVect *from, cpVect *to
+) {
+    random_line(ctx, cpBBNew(100., 500., ARENA_W - 100., 1000.), from, to);
+}
+
+// Сверка аналитических масок с геометрией: каждая вершина куска должна лежать
+// внутри прямоугольника глифа и внутри или на всех плоскостях маски.
+static int check_masks(SplitterCore *core) {
+    const double eps = 0.05;
+    int errors = 0;
+    de_view v = de_create_view(
+        core->r, 2, (de_cp_type[2]) { comp_mesh, comp_mask }
+    );
+    while (de_view_valid(&v)) {
+        struct Component_Mesh *mesh = de_view_get(&v, comp_mesh);
+        struct Component_Mask *m = de_view_get(&v, comp_mask);
+        cpTransform body2glyph = cpTransformInverse(m->tr);
+        bool ok = true;
+        for (int i = 0; i < mesh->verts_num && ok; i++) {
+            cpVect p = cpTransformPoint(body2glyph, mesh->verts[i]);
+            if (fabs(p.x) > m->size.x / 2. + eps ||
+                fabs(p.y) > m->size.y / 2. + eps)
+                ok = false;
+            for (int j = 0; j < m->planes.num; j++)
+                if (cpvdot(m->planes.n[j], p) - m->planes.dist[j] > eps)
+                    ok = false;
+        }
+        if (!ok)
+            errors++;
+        de_view_next(&v);
+    }
+    return errors;
+}
+
+// Разрез применяется до возврата core_slice_polyline(), без шага. Иначе
+// он ждал бы следующего шага, а цели, собранные позже, могли бы указывать
+// на уже разрезанные формы.
+static int run_slice_check(void) {
+    SplitterCore core;
+    bench_core_init(&core, (struct RunOpts) {0});
+    cpVect center = { ARENA_W / 2., ARENA_H / 2. };
+    core_create_box(&core, center, (cpVect) { GLYPH_W, GLYPH_H });
+    // Границы формы обновляются шагом
+    core_step(&core, 1. / 60);
+
+    int errors = 0;
+    int before = core_fragment_count(&core);
+    core_slice(
+        &core, cpvadd(center, cpv(0., -ARENA_H)),
+        cpvadd(center, cpv(0., ARENA_H))
+    );
+    if (core_fragment_count(&core) != before + 1)
+        errors++;
+
+    // Ломаная задевает обе половины, каждая режется один раз
+    before = core_fragment_count(&core);
+    cpVect pts[3] = {
+        cpvadd(center, cpv(-ARENA_W, -10.)),
+        cpvadd(center, cpv(0., 10.)),
+        cpvadd(center, cpv(ARENA_W, -10.)),
+    };
+    core_slice_polyline(&core, pts, 3);
+    if (core_fragment_count(&core) != before + 2)
+        errors++;
+
+    printf(
+        "slice_check: fragments %d  %s\n", core_fragment_count(&core),
+        errors ? "FAILED, slices are deferred" : "ok"
+    );
+    core_shutdown(&core);
+    return errors;
+}
+
+static struct Scene scenes[] = {
+    { "grid",       false,  setup_grid,     slice_grid      },
+    { "shatter",    false,  setup_shatter,  slice_shatter   },
+    { "pile",       true,   setup_pile,     slice_pile      },
+};
+
+static void print_pool(SplitterCore *core) {
+    struct FragmentPoolStats *ps = &core->pool.stats;
+    uint64_t reused = ps->bodies_reused + ps->shapes_reused + ps->meshes_reused;
+    uint64_t heap = pool_heap_allocs(&core->pool);
+    uint64_t cuts = core->stats.shapes_cut;
+    printf("  heap allocs/cut   %.2f\n", cuts ? (double)heap / cuts : 0.);
+    printf("  pool reuse        %.1f %%\n",
+           heap + reused ? 100. * reused / (heap + reused) : 0.);
+    printf("  pool memory       live %zu KB, free %zu KB\n",
+           ps->bytes_live / 1024, ps->bytes_free / 1024);
+}
+
+#define QUERY_ROUNDS    1000
+
+static void count_query(cpShape *shape, void *data) {
+    (*(int*)data)++;
+}
+
+static void count_segment_query(
+    cpShape *shape, cpVect point, cpVect normal, cpFloat alpha, void *data
+) {
+    (*(int*)data)++;
+}
+
+// Среднее время запроса отрезком через всю арену и прямоугольником
+// размером с глиф, в секундах.
+static void measure_queries(
+    SplitterCore *core, struct BenchCtx *ctx, double *segment, double *bb
+) {
+    int hits = 0;
+    double start = core_time();
+    for (int i = 0; i < QUERY_ROUNDS; i++) {
+        cpVect from, to;
+        random_line(ctx, cpBBNew(0., -1000., ARENA_W, ARENA_H), &from, &to);
+        cpSpaceSegmentQuery(
+            core->space, from, to, 0., CP_SHAPE_FILTER_ALL,
+            count_segment_query, &hits
+        );
+    }
+    *segment = (core_time() - start) / QUERY_ROUNDS;
+
+    start = core_time();
+    for (int i = 0; i < QUERY_ROUNDS; i++) {
+        cpVect p = {
+            rng_float(ctx, 0., ARENA_W),
+            rng_float(ctx, -1000., ARENA_H),
+        };
+        cpSpaceBBQuery(
+            core->space, cpBBNewForExtents(p, GLYPH_W / 2., GLYPH_H / 2.),
+            CP_SHAPE_FILTER_ALL, count_query, &hits
+        );
+    }
+    *bb = (core_time() - start) / QUERY_ROUNDS;
+}
+
+static void run_scene(struct Scene *scene, int slices, struct RunOpts opts) {
+    struct BenchCtx ctx = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+    };
+    SplitterCore core;
+    opts.gravity = scene->gravity;
+    bench_core_init(&core, opts);
+    core.hooks.on_poststep = on_poststep;
+    core.udata = &ctx;
+
+    scene->setup(&core, &ctx);
+    int bodies_start = core_body_count(&core);
+
+    double step_total = 0.;
+    double time_start = core_time();
+    for (int i = 0; i < slices; i++) {
+        cpVect from, to;
+        scene->next_slice(&core, &ctx, &from, &to);
+        core_slice(&core, from, to);
+        double step_start = core_time();
+        core_step(&core, 1. / 60);
+        step_total += core_time() - step_start;
+    }
+    double elapsed = core_time() - time_start;
+    double query_segment, query_bb;
+    measure_queries(&core, &ctx, &query_segment, &query_bb);
+
+    qsort(
+        ctx.poststep.arr, ctx.poststep.num, sizeof(ctx.poststep.arr[0]),
+        cmp_double
+    );
+
+    printf("scene %s%s", scene->name, opts.nopool ? "/nopool" : "");
+    if (opts.budget.max_fragments)
+        printf("/budget-%d-%s", opts.budget.max_fragments,
+               evict_policy2str(opts.budget.policy));
+    if (opts.lod_area > 0.)
+        printf("/lod-%.0f", opts.lod_area);
+    if (opts.bake)
+        printf("/bake");
+    if (opts.threads)
+        printf("/threads-%d", opts.threads);
+    if (opts.broadphase != BROADPHASE_BBTREE)
+        printf("/%s", broadphase2str(opts.broadphase));
+    printf("\n");
+    printf("  slices            %d\n", slices);
+    printf("  elapsed           %.3f s\n", elapsed);
+    printf("  slices/sec        %.1f\n", slices / elapsed);
+    printf("  step avg          %.3f ms\n", step_total / slices * 1000.);
+    printf("  query segment     %.1f us\n", query_segment * 1e6);
+    printf("  query bb          %.1f us\n", query_bb * 1e6);
+    if (core.broadphase_state.type == BROADPHASE_HASH)
+        printf("  hash              dim %.1f, count %d, rebuilds %llu\n",
+               core.broadphase_state.dim, core.broadphase_state.count,
+               (unsigned long long)core.broadphase_state.rebuilds);
+    printf("  shapes cut        %llu\n",
+           (unsigned long long)core.stats.shapes_cut);
+    printf("  post-step p50     %.1f us\n",
+           samples_percentile(&ctx.poststep, 0.50) * 1e6);
+    printf("  post-step p90     %.1f us\n",
+           samples_percentile(&ctx.poststep, 0.90) * 1e6);
+    printf("  post-step p99     %.1f us\n",
+           samples_percentile(&ctx.poststep, 0.99) * 1e6);
+    printf("  post-step max     %.1f us\n",
+           samples_percentile(&ctx.poststep, 1.) * 1e6);
+    printf("  bodies            %d -> %d\n",
+           bodies_start, core_body_count(&core));
+    printf("  mask errors       %d\n", check_masks(&core));
+    printf("  fragments         %d, evicted %llu\n",
+           core_fragment_count(&core),
+           (unsigned long long)core.stats.fragments_evicted);
+    printf("  particles         %d, spawned %llu\n",
+           core_particle_count(&core),
+           (unsigned long long)core.stats.particles_spawned);
+    printf("  baked             %d, baked %llu, unbaked %llu\n",
+           core_baked_count(&core),
+           (unsigned long long)core.stats.fragments_baked,
+           (unsigned long long)core.stats.fragments_unbaked);
+    printf("  arena peak        %zu bytes, %zu blocks\n",
+           core.frame_arena.peak, core.frame_arena.blocks_allocated);
+    print_pool(&core);
+
+    core_shutdown(&core);
+    free(ctx.poststep.arr);
+}
+
+#define SWIPE_POINTS    16
+
+// Волнистая ломаная слева направо через сетку из setup_grid()
+static void make_swipe(struct BenchCtx *ctx, cpVect *pts, int num) {
+    double y = rng_float(ctx, -500., 200.);
+    for (int i = 0; i < num; i++) {
+        pts[i].x = -50. + i * (ARENA_W + 100.) / (num - 1);
+        pts[i].y = y + rng_float(ctx, -60., 60.);
+        y += rng_float(ctx, -40., 40.);
+    }
+}
+
+// Жест целиком через core_slice_polyline() против того же жеста, разбитого
+// на отдельные разрезы по кадрам.
+static void run_swipe(bool polyline, int swipes) {
+    struct BenchCtx ctx = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+    };
+    SplitterCore core;
+    bench_core_init(&core, (struct RunOpts) {0});
+    core.hooks.on_poststep = on_poststep;
+    core.udata = &ctx;
+
+    setup_grid(&core, &ctx);
+    int bodies_start = core_body_count(&core);
+
+    int steps = 0;
+    double time_start = core_time();
+    for (int i = 0; i < swipes; i++) {
+        cpVect pts[SWIPE_POINTS];
+        make_swipe(&ctx, pts, SWIPE_POINTS);
+        if (polyline) {
+            core_slice_polyline(&core, pts, SWIPE_POINTS);
+            core_step(&core, 1. / 60);
+            steps++;
+        } else {
+            for (int j = 0; j + 1 < SWIPE_POINTS; j++) {
+                core_slice(&core, pts[j], pts[j + 1]);
+                core_step(&core, 1. / 60);
+                steps++;
+            }
+        }
+    }
+    double elapsed = core_time() - time_start;
+
+    qsort(
+        ctx.poststep.arr, ctx.poststep.num, sizeof(ctx.poststep.arr[0]),
+        cmp_double
+    );
+
+    printf("scene swipe/%s\n", polyline ? "polyline" : "segments");
+    printf("  swipes            %d\n", swipes);
+    printf("  steps             %d\n", steps);
+    printf("  elapsed           %.3f s\n", elapsed);
+    printf("  swipes/sec        %.1f\n", swipes / elapsed);
+    printf("  shapes cut        %llu\n",
+           (unsigned long long)core.stats.shapes_cut);
+    printf("  post-step calls   %d\n", ctx.poststep.num);
+    printf("  post-step p99     %.1f us\n",
+           samples_percentile(&ctx.poststep, 0.99) * 1e6);
+    printf("  bodies            %d -> %d\n",
+           bodies_start, core_body_count(&core));
+    printf("  mask errors       %d\n", check_masks(&core));
+    printf("  arena peak        %zu bytes, %zu blocks\n",
+           core.frame_arena.peak, core.frame_arena.blocks_allocated);
+
+    core_shutdown(&core);
+    free(ctx.poststep.arr);
+}
+
+// Прежний способ: две обрезки по n и -n, потом площадь и центр масс.
+static int clip_reference(
+    const cpVect *verts, int count, cpVect n, cpFloat dist, cpVect *clipped
+) {
+    int num = 0;
+    for (int i = 0, j = count - 1; i < count; j = i, i++) {
+        cpVect a = verts[j], b = verts[i];
+        cpFloat a_dist = cpvdot(a, n) - dist, b_dist = cpvdot(b, n) - dist;
+        if (a_dist < 0.)
+            clipped[num++] = a;
+        if (a_dist * b_dist < 0.) {
+            cpFloat t = cpfabs(a_dist) / (cpfabs(a_dist) + cpfabs(b_dist));
+            clipped[num++] = cpvlerp(a, b, t);
+        }
+    }
+    return num;
+}
+
+#define CLIP_POLYS      1024
+#define CLIP_MAX_VERTS  64
+
+// Правильные многоугольники со смещенными вершинами и плоскости через них
+static void run_clip(int rounds) {
+    struct BenchCtx ctx = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+    };
+    static cpVect verts[CLIP_POLYS][CLIP_MAX_VERTS];
+    static cpFloat xs[CLIP_POLYS][CLIP_MAX_VERTS], ys[CLIP_POLYS][CLIP_MAX_VERTS];
+    static cpVect planes_n[CLIP_POLYS];
+    static cpFloat planes_dist[CLIP_POLYS];
+
+    printf("clip kernel %s\n", clip_kernel_name());
+    for (int count = 4; count <= CLIP_MAX_VERTS; count *= 2) {
+        for (int k = 0; k < CLIP_POLYS; k++) {
+            cpVect center = {
+                rng_float(&ctx, 0., ARENA_W), rng_float(&ctx, 0., ARENA_H),
+            };
+            for (int i = 0; i < count; i++) {
+                cpFloat angle = 2. * CP_PI * i / count;
+                cpFloat radius = rng_float(&ctx, 90., 100.);
+                verts[k][i] = cpvadd(center, cpvmult(cpvforangle(angle), radius));
+            }
+            clip_transform(
+                verts[k], count, cpTransformIdentity, xs[k], ys[k]
+            );
+            planes_n[k] = cpvforangle(rng_float(&ctx, 0., 2. * CP_PI));
+            planes_dist[k] = cpvdot(center, planes_n[k]) +
+                rng_float(&ctx, -50., 50.);
+        }
+
+        cpVect half1[CLIP_MAX_VERTS + 1], half2[CLIP_MAX_VERTS + 1];
+        cpFloat checksum_ref = 0.;
+        double time_start = core_time();
+        for (int r = 0; r < rounds; r++)
+            for (int k = 0; k < CLIP_POLYS; k++) {
+                cpVect n = planes_n[k];
+                cpFloat dist = planes_dist[k];
+                int num1 = clip_reference(verts[k], count, n, dist, half1);
+                int num2 = clip_reference(verts[k], count, cpvneg(n), -dist, half2);
+                checksum_ref += cpAreaForPoly(num1, half1, 0.) +
+                    cpAreaForPoly(num2, half2, 0.);
+                checksum_ref += cpCentroidForPoly(num1, half1).x +
+                    cpCentroidForPoly(num2, half2).x;
+            }
+        double elapsed_ref = core_time() - time_start;
+
+        cpFloat bx[CLIP_MAX_VERTS + 1], by[CLIP_MAX_VERTS + 1];
+        cpFloat ax[CLIP_MAX_VERTS + 1], ay[CLIP_MAX_VERTS + 1];
+        cpFloat d[CLIP_MAX_VERTS];
+        cpFloat checksum = 0.;
+        time_start = core_time();
+        for (int r = 0; r < rounds; r++)
+            for (int k = 0; k < CLIP_POLYS; k++) {
+                struct ClipHalf below = { .x = bx, .y = by };
+                struct ClipHalf above = { .x = ax, .y = ay };
+                if (!clip_split(
+                    xs[k], ys[k], count, planes_n[k], planes_dist[k], d,
+                    &below, &above
+                ))
+                    continue;
+                checksum += below.area + above.area;
+                checksum += below.centroid.x + above.centroid.x;
+            }
+        double elapsed = core_time() - time_start;
+
+        double splits = (double)rounds * CLIP_POLYS;
+        printf(
+            "  verts %2d  reference %7.1f ns  split %7.1f ns  x%.2f  "
+            "checksum diff %g\n",
+            count, elapsed_ref / splits * 1e9, elapsed / splits * 1e9,
+            elapsed > 0. ? elapsed_ref / elapsed : 0.,
+            fabs(checksum - checksum_ref)
+        );
+    }
+}
+
+static void count_awake(cpBody *body, void *data) {
+    if (!cpBodyIsSleeping(body))
+        (*(int*)data)++;
+}
+
+static int awake_count(SplitterCore *core) {
+    int num = 0;
+    cpSpaceEachBody(core->space, count_awake, &num);
+    return num;
+}
+
+// Куча из num ящиков на полу, steps шагов решателя cpHastySpace.
+static void run_hasty(int num, int threads, int steps) {
+    struct BenchCtx ctx = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+    };
+    SplitterCore core;
+    bench_core_init(&core, (struct RunOpts) {
+        .step_threads = threads,
+        .gravity = true,
+        .walls = true,
+    });
+
+    const int cols = 48;
+    const double size = (ARENA_W - 400.) / cols;
+    for (int i = 0; i < num; i++) {
+        cpVect center = {
+            200. + (i % cols + 0.5) * size + rng_float(&ctx, -2., 2.),
+            ARENA_H - 100. - (i / cols + 0.5) * size,
+        };
+        core_create_box(&core, center, (cpVect) { size - 4., size - 4. });
+    }
+
+    struct Samples samples = {0};
+    double time_start = core_time();
+    for (int i = 0; i < steps; i++) {
+        double step_start = core_time();
+        core_step(&core, 1. / 60);
+        samples_push(&samples, core_time() - step_start);
+    }
+    double elapsed = core_time() - time_start;
+    qsort(samples.arr, samples.num, sizeof(samples.arr[0]), cmp_double);
+
+    printf(
+        "hasty bodies %5d  threads %d (got %d)  step avg %7.3f ms  "
+        "p50 %7.3f ms  p99 %7.3f ms  awake %d\n",
+        num, threads, core_step_threads(&core), elapsed / steps * 1000.,
+        samples_percentile(&samples, 0.50) * 1000.,
+        samples_percentile(&samples, 0.99) * 1000.,
+        awake_count(&core)
+    );
+
+    core_shutdown(&core);
+    free(samples.arr);
+}
+
+// seconds секунд симуляции кучи при разной частоте кадров. Число шагов и
+// их стоимость от частоты кадров зависеть не должны.
+static void run_clock(double fps, double seconds) {
+    struct BenchCtx ctx = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+    };
+    SplitterCore core;
+    bench_core_init(&core, (struct RunOpts) { .gravity = true });
+    setup_pile(&core, &ctx);
+
+    int frames = (int)(seconds * fps);
+    double step_total = 0.;
+    for (int i = 0; i < frames; i++) {
+        // Каждый 50-й кадр просажен в 10 раз
+        double frame_dt = i % 50 == 49 ? 10. / fps : 1. / fps;
+        double start = core_time();
+        core_advance(&core, frame_dt);
+        step_total += core_time() - start;
+    }
+
+    printf(
+        "clock fps %5.0f  frames %6d  steps %6llu  capped %4llu  "
+        "sim cost %7.3f ms/s\n",
+        fps, frames, (unsigned long long)core.clock.steps,
+        (unsigned long long)core.clock.frames_capped,
+        step_total / seconds * 1000.
+    );
+
+    core_shutdown(&core);
+}
+
+#define SDF_SCALE   8
+#define SDF_SPREAD  4.f
+
+// Кольцо размером с глиф: точность поля против аналитического расстояния и
+// память против RGBA страницы того же глифа
+static void run_sdf(int rounds) {
+    int w = GLYPH_W, h = GLYPH_H;
+    float cx = w / 2.f, cy = h / 2.f, r_out = 120.f, r_in = 60.f;
+    uint8_t *alpha = malloc(w * h);
+    assert(alpha);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            float r = hypotf(x + 0.5f - cx, y + 0.5f - cy);
+            alpha[y * w + x] = r <= r_out && r >= r_in ? 255 : 0;
+        }
+
+    int out_w = sdf_size(w, SDF_SCALE), out_h = sdf_size(h, SDF_SCALE);
+    uint8_t *out = malloc(out_w * out_h);
+    assert(out);
+    double time_start = core_time();
+    for (int i = 0; i < rounds; i++)
+        sdf_generate(alpha, w, h, SDF_SCALE, SDF_SPREAD, out);
+    double time_ms = (core_time() - time_start) / rounds * 1000.;
+
+    // Ошибка только в полосе, где поле не насыщено
+    float err_max = 0.f, band = SDF_SPREAD * SDF_SCALE - SDF_SCALE;
+    int checked = 0;
+    for (int y = 0; y < out_h; y++)
+        for (int x = 0; x < out_w; x++) {
+            float px = (x + 0.5f) * SDF_SCALE, py = (y + 0.5f) * SDF_SCALE;
+            float r = hypotf(px - cx, py - cy);
+            float exact = fmaxf(r - r_out, r_in - r);
+            if (fabsf(exact) > band)
+                continue;
+            float got = sdf_decode(out[y * out_w + x], SDF_SCALE, SDF_SPREAD);
+            err_max = fmaxf(err_max, fabsf(got - exact));
+            checked++;
+        }
+
+    printf(
+        "sdf %dx%d -> %dx%d  %7.3f ms  err max %.2f px (%d texels)  "
+        "bytes %d -> %d\n",
+        w, h, out_w, out_h, time_ms, err_max, checked,
+        w * h * 4, out_w * out_h
+    );
+
+    free(out);
+    free(alpha);
+}
+
+#define SNAPSHOT_FRAGMENTS   5000
+#define SNAPSHOT_PATH        "splitter_bench.snap"
+
+static cpFloat bodies_checksum(SplitterCore *core) {
+    cpFloat sum = 0.;
+    for (int i = 0; i < core->fragments_num; i++) {
+        struct FragmentState s = core_fragment_state(core, core->fragments[i]);
+        sum += s.p.x + s.p.y + s.a;
+    }
+    return sum;
+}
+
+// Куча, разрезанная до SNAPSHOT_FRAGMENTS кусков, сохраняется и rounds раз
+// восстанавливается в чистое ядро. Файл остается как готовая сцена.
+static void run_snapshot(int rounds) {
+    struct BenchCtx ctx = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+    };
+    SplitterCore core;
+    bench_core_init(&core, (struct RunOpts) { .bake = true, .gravity = true });
+    setup_pile(&core, &ctx);
+    while (core_fragment_count(&core) < SNAPSHOT_FRAGMENTS) {
+        cpVect from, to;
+        slice_pile(&core, &ctx, &from, &to);
+        core_slice(&core, from, to);
+        core_step(&core, 1. / 60);
+    }
+    for (int i = 0; i < 120; i++)
+        core_step(&core, 1. / 60);
+
+    double time_start = core_time();
+    bool ok = snapshot_save(&core, SNAPSHOT_PATH, NULL, NULL);
+    double save_ms = (core_time() - time_start) * 1000.;
+    int fragments = core_fragment_count(&core);
+    int baked = core_baked_count(&core);
+    cpFloat checksum = bodies_checksum(&core);
+    core_shutdown(&core);
+    if (!ok) {
+        printf("snapshot: could not save %s\n", SNAPSHOT_PATH);
+        return;
+    }
+
+    double load_total = 0., load_worst = 0.;
+    int mismatches = 0;
+    for (int r = 0; r < rounds; r++) {
+        SplitterCore restored;
+        bench_core_init(&restored, (struct RunOpts) { .walls = true });
+        time_start = core_time();
+        snapshot_load(&restored, SNAPSHOT_PATH, NULL, NULL);
+        double dt = core_time() - time_start;
+        load_total += dt;
+        if (dt > load_worst)
+            load_worst = dt;
+        if (core_fragment_count(&restored) != fragments ||
+            core_baked_count(&restored) != baked ||
+            fabs(bodies_checksum(&restored) - checksum) > 1e-6)
+            mismatches++;
+        core_shutdown(&restored);
+    }
+
+    printf(
+        "snapshot %s  fragments %d  baked %d  save %.3f ms  "
+        "load mean %.3f ms  worst %.3f ms  mismatches %d\n",
+        SNAPSHOT_PATH, fragments, baked, save_ms,
+        load_total / rounds * 1000., load_worst * 1000., mismatches
+    );
+}
+
+#define RASTER_FRAGMENTS    2000
+
+struct RasterJob {
+    // Вершины кусков подряд, в пикселях маски
+    cpVect      *verts;
+    int         *first, *num;
+    cpVect      *size;
+    uint8_t     **out;
+};
+
+static void raster_job(void *udata, int index, int worker) {
+    struct RasterJob *job = udata;
+    raster_convex(
+        job->verts + job->first[index], job->num[index],
+        job->size[index].x, job->size[index].y, job->out[index]
+    );
+}
+
+// Маски кусков кучи: попиксельная проверка плоскостей против построчной
+// растеризации треугольников куска, по одной маске и по потокам.
+static void run_raster(int rounds) {
+    struct BenchCtx ctx = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+    };
+    SplitterCore core;
+    bench_core_init(&core, (struct RunOpts) { .gravity = true });
+    setup_pile(&core, &ctx);
+    while (core_fragment_count(&core) < RASTER_FRAGMENTS) {
+        cpVect from, to;
+        slice_pile(&core, &ctx, &from, &to);
+        core_slice(&core, from, to);
+        core_step(&core, 1. / 60);
+    }
+
+    int cap = core.fragments_num, num = 0, verts_num = 0;
+    struct ClipPlanes *planes = malloc(sizeof(planes[0]) * cap);
+    struct RasterJob job = {
+        .first = malloc(sizeof(job.first[0]) * cap),
+        .num = malloc(sizeof(job.num[0]) * cap),
+        .size = malloc(sizeof(job.size[0]) * cap),
+        .out = malloc(sizeof(job.out[0]) * cap),
+    };
+    uint8_t **ref = malloc(sizeof(ref[0]) * cap);
+    assert(planes && job.first && job.num && job.size && job.out && ref);
+
+    de_view v = de_create_view(
+        core.r, 2, (de_cp_type[2]) { comp_mesh, comp_mask }
+    );
+    while (de_view_valid(&v)) {
+        struct Component_Mesh *mesh = de_view_get(&v, comp_mesh);
+        struct Component_Mask *m = de_view_get(&v, comp_mask);
+        int w = m->size.x, h = m->size.y;
+        cpTransform body2glyph = cpTransformInverse(m->tr);
+        job.verts = realloc(
+            job.verts, sizeof(job.verts[0]) * (verts_num + mesh->verts_num)
+        );
+        assert(job.verts);
+        for (int i = 0; i < mesh->verts_num; i++) {
+            cpVect g = cpTransformPoint(body2glyph, mesh->verts[i]);
+            job.verts[verts_num + i] = cpv(g.x + w / 2., g.y + h / 2.);
+        }
+        planes[num] = m->planes;
+        job.first[num] = verts_num;
+        job.num[num] = mesh->verts_num;
+        job.size[num] = m->size;
+        job.out[num] = malloc(w * h);
+        ref[num] = malloc(w * h);
+        assert(job.out[num] && ref[num]);
+        verts_num += mesh->verts_num;
+        num++;
+        de_view_next(&v);
+    }
+    core_shutdown(&core);
+
+    double time_start = core_time();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < num; i++)
+            planes_rasterize(
+                &planes[i], job.size[i].x, job.size[i].y, ref[i]
+            );
+    double planes_ms = (core_time() - time_start) / rounds * 1000.;
+
+    time_start = core_time();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < num; i++)
+            raster_job(&job, i, 0);
+    double raster_ms = (core_time() - time_start) / rounds * 1000.;
+
+    // Расхождения допустимы только на границе, где центр пикселя лежит на
+    // ребре с точностью до округления
+    int64_t pixels = 0, mismatches = 0;
+    for (int i = 0; i < num; i++) {
+        int n = job.size[i].x * job.size[i].y;
+        for (int k = 0; k < n; k++)
+            mismatches += job.out[i][k] != ref[i][k];
+        pixels += n;
+    }
+
+    printf(
+        "raster masks %d  pixels %ld  planes %8.3f ms  scanline %8.3f ms  "
+        "mismatches %ld\n",
+        num, (long)pixels, planes_ms, raster_ms, (long)mismatches
+    );
+
+    int threads[] = { 1, 2, 4, 8 };
+    for (int j = 0; j < 4; j++) {
+        struct WorkerPool pool = {0};
+        workers_init(&pool, threads[j] - 1);
+        time_start = core_time();
+        for (int r = 0; r < rounds; r++)
+            workers_run(&pool, raster_job, &job, num);
+        double ms = (core_time() - time_start) / rounds * 1000.;
+        workers_shutdown(&pool);
+        printf("raster threads %d  scanline %8.3f ms\n", threads[j], ms);
+    }
+
+    for (int i = 0; i < num; i++) {
+        free(job.out[i]);
+        free(ref[i]);
+    }
+    free(ref);
+    free(job.out);
+    free(job.size);
+    free(job.num);
+    free(job.first);
+    free(job.verts);
+    free(planes);
+}
+
+// Журнал из splitter --record. Время шагов в timing_path построчно.
+static int run_replay(const char *path, const char *timing_path) {
+    FILE *timing = NULL;
+    if (timing_path) {
+        timing = fopen(timing_path, "w");
+        if (!timing) {
+            fprintf(stderr, "splitter_bench: could not open %s\n", timing_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct ReplayStats stats, again;
+    double time_start = core_time();
+    bool ok = replay_run(path, timing, &stats);
+    double time_wall = core_time() - time_start;
+    if (timing)
+        fclose(timing);
+    if (!ok) {
+        fprintf(stderr, "splitter_bench: could not replay %s\n", path);
+        return EXIT_FAILURE;
+    }
+    // Второй прогон того же файла: куча уже другая, адреса форм тоже
+    if (!replay_run(path, NULL, &again)) {
+        fprintf(stderr, "splitter_bench: could not replay %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    printf(
+        "replay %s  steps %llu  events %llu  wall %.3f s\n"
+        "  step mean %.3f ms  worst %.3f ms\n"
+        "  bodies %d  fragments %d  particles %d  checksum %.6f\n",
+        path, (unsigned long long)stats.steps,
+        (unsigned long long)stats.events, time_wall,
+        stats.steps ? stats.total / stats.steps * 1000. : 0.,
+        stats.worst * 1000., stats.bodies, stats.fragments, stats.particles,
+        stats.checksum
+    );
+    if (again.steps != stats.steps || again.bodies != stats.bodies ||
+        again.fragments != stats.fragments ||
+        again.particles != stats.particles ||
+        again.checksum != stats.checksum) {
+        printf(
+            "  second run differs: bodies %d  fragments %d  particles %d  "
+            "checksum %.6f\n",
+            again.bodies, again.fragments, again.particles, again.checksum
+        );
+        return EXIT_FAILURE;
+    }
+    printf("  second run matches\n");
+    return EXIT_SUCCESS;
+}
+
+#define REPLAY_CHECK_PATH   "splitter_bench.replay"
+#define REPLAY_CHECK_STEPS  600
+
+// Журнал из двух сессий с разрезами ломаными, как его пишет splitter
+// --record. Событие с шагом N применяется до шага N + 1.
+static bool record_check(const char *path) {
+    struct BenchCtx ctx = {
+        .rng = 0x9E3779B97F4A7C15ULL,
+    };
+    const struct RunOpts opts = {
+        .gravity = true,
+        .walls = true,
+    };
+    SplitterCore core;
+    bench_core_init(&core, opts);
+    struct ReplayRecorder rec;
+    if (!replay_record_open(&rec, path, ctx.rng, &core.clock)) {
+        core_shutdown(&core);
+        return false;
+    }
+
+    for (int session = 0; session < 2; session++) {
+        if (session) {
+            replay_record_reset(&rec, core.clock.steps);
+            core_shutdown(&core);
+            bench_core_init(&core, opts);
+            replay_record_resume(&rec);
+        }
+        cpVect g = cpSpaceGetGravity(core.space);
+        replay_record(&rec, 0, REPLAY_GRAVITY, &g, sizeof(g));
+        replay_record_opts(&rec, &core);
+        replay_record(&rec, 0, REPLAY_WALLS, NULL, 0);
+
+        for (int i = 0; i < 6; i++) {
+            struct ReplaySpawn spawn = {
+                .center = { rng_float(&ctx, 300., ARENA_W - 300.), -i * 200. },
+                .wh = { GLYPH_W, GLYPH_H },
+                .ch = 'A' + i,
+            };
+            de_entity e = core_create_box(&core, spawn.center, spawn.wh);
+            replay_record(&rec, 0, REPLAY_SPAWN, &spawn, sizeof(spawn));
+            core_diagonal_slice(&core, e);
+            replay_record(&rec, 0, REPLAY_DIAGONAL, NULL, 0);
+        }
+
+        for (int step = 0; step < REPLAY_CHECK_STEPS; step++) {
+            if (step % 20 == 10) {
+                cpVect pts[3];
+                random_line(
+                    &ctx, cpBBNew(100., 300., ARENA_W - 100., 1000.),
+                    &pts[0], &pts[2]
+                );
+                pts[1] = cpvlerp(pts[0], pts[2], 0.5);
+                pts[1].y += rng_float(&ctx, -100., 100.);
+                core_slice_polyline(&core, pts, 3);
+                replay_record(
+                    &rec, core.clock.steps, REPLAY_SLICE, pts, sizeof(pts)
+                );
+            }
+            core_advance(&core, core.clock.step);
+        }
+    }
+
+    replay_record_close(&rec, core.clock.steps);
+    core_shutdown(&core);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *scene_name = argc > 1 ? argv[1] : "all";
+    if (!strcmp(scene_name, "slice_check")) {
+        logger_init();
+        log_init();
+        int ret = run_slice_check() ? EXIT_FAILURE : EXIT_SUCCESS;
+        log_shutdown();
+        logger_shutdown();
+        return ret;
+    }
+    // Детерминизм воспроизведения без записанного в окне журнала
+    if (!strcmp(scene_name, "replay_check")) {
+        logger_init();
+        log_init();
+        int ret = record_check(REPLAY_CHECK_PATH) ?
+            run_replay(REPLAY_CHECK_PATH, NULL) : EXIT_FAILURE;
+        log_shutdown();
+        logger_shutdown();
+        return ret;
+    }
+    if (!strcmp(scene_name, "replay")) {
+        if (argc < 3) {
+            fprintf(stderr, "splitter_bench: replay FILE [timing.csv]\n");
+            return EXIT_FAILURE;
+        }
+        logger_init();
+        log_init();
+        int ret = run_replay(argv[2], argc > 3 ? argv[3] : NULL);
+        log_shutdown();
+        logger_shutdown();
+        return ret;
+    }
+
+    int slices = argc > 2 ? atoi(argv[2]) : 1000;
+    if (slices <= 0) {
+        fprintf(stderr, "splitter_bench: bad slices number\n");
+        return EXIT_FAILURE;
+    }
+
+    logger_init();
+    log_init();
+
+    const struct RunOpts defaults = {0};
+
+    int scenes_num = sizeof(scenes) / sizeof(scenes[0]);
+    bool found = false;
+    for (int i = 0; i < scenes_num; i++) {
+        if (!strcmp(scene_name, "all") || !strcmp(scene_name, scenes[i].name)) {
+            run_scene(&scenes[i], slices, defaults);
+            found = true;
+        }
+    }
+
+    // Обращения к куче на разрез с пулом и без
+    if (!strcmp(scene_name, "pool")) {
+        for (int i = 0; i < scenes_num; i++) {
+            run_scene(&scenes[i], slices, (struct RunOpts) { .nopool = true });
+            run_scene(&scenes[i], slices, defaults);
+        }
+        found = true;
+    }
+
+    // Стоимость шага при постоянном разрезании с ограничением числа кусков
+    if (!strcmp(scene_name, "budget")) {
+        enum EvictPolicy policies[] = { EVICT_SMALLEST, EVICT_OLDEST };
+        for (int i = 0; i < scenes_num; i++) {
+            run_scene(&scenes[i], slices, defaults);
+            for (int j = 0; j < 2; j++)
+                run_scene(&scenes[i], slices, (struct RunOpts) {
+                    .budget = {
+                        .max_fragments = 64,
+                        .policy = policies[j],
+                    },
+                });
+        }
+        found = true;
+    }
+
+    // Мелкие куски частицами против полноценных тел
+    if (!strcmp(scene_name, "lod")) {
+        for (int i = 0; i < scenes_num; i++) {
+            run_scene(&scenes[i], slices, defaults);
+            run_scene(&scenes[i], slices, (struct RunOpts) {
+                .lod_area = 400.,
+            });
+        }
+        found = true;
+    }
+
+    // Уснувшие куски в статическом слое против спящих тел
+    if (!strcmp(scene_name, "bake")) {
+        for (int i = 0; i < scenes_num; i++) {
+            run_scene(&scenes[i], slices, defaults);
+            run_scene(&scenes[i], slices, (struct RunOpts) { .bake = true });
+        }
+        found = true;
+    }
+
+    // Геометрия разрезов в пуле потоков
+    if (!strcmp(scene_name, "threads")) {
+        int threads[] = { 0, 1, 2, 4, 8 };
+        for (int i = 0; i < scenes_num; i++)
+            for (int j = 0; j < 5; j++)
+                run_scene(&scenes[i], slices, (struct RunOpts) {
+                    .threads = threads[j],
+                });
+        found = true;
+    }
+
+    // Масштабирование шага физики по числу потоков и кусков
+    if (!strcmp(scene_name, "hasty")) {
+        int threads[] = { 1, 2, 4, 8 };
+        int bodies[] = { 256, 1024, 4096 };
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 4; j++)
+                run_hasty(bodies[i], threads[j], slices);
+        found = true;
+    }
+
+    // Запросы и шаг с BB деревом и с подобранным пространственным хэшем
+    if (!strcmp(scene_name, "broadphase")) {
+        for (int i = 0; i < scenes_num; i++) {
+            run_scene(&scenes[i], slices, defaults);
+            run_scene(&scenes[i], slices, (struct RunOpts) {
+                .broadphase = BROADPHASE_HASH,
+            });
+        }
+        found = true;
+    }
+
+    // Шаг симуляции отвязан от частоты кадров
+    if (!strcmp(scene_name, "clock")) {
+        double fps[] = { 30., 60., 144., 240. };
+        for (int i = 0; i < 4; i++)
+            run_clock(fps[i], 10.);
+        found = true;
+    }
+
+    // Поле расстояний для глифов, без GPU
+    if (!strcmp(scene_name, "sdf")) {
+        run_sdf(slices / 100 > 0 ? slices / 100 : 1);
+        found = true;
+    }
+
+    // Восстановление тяжелой сцены из файла
+    if (!strcmp(scene_name, "snapshot")) {
+        run_snapshot(slices / 100 > 0 ? slices / 100 : 1);
+        found = true;
+    }
+
+    // Маски кусков на CPU, без GPU
+    if (!strcmp(scene_name, "raster")) {
+        run_raster(slices / 100 > 0 ? slices / 100 : 1);
+        found = true;
+    }
+
+    if (!strcmp(scene_name, "clip")) {
+        run_clip(slices);
+        found = true;
+    }
+
+    if (!strcmp(scene_name, "all") || !strcmp(scene_name, "swipe")) {
+        int swipes = slices / SWIPE_POINTS > 0 ? slices / SWIPE_POINTS : 1;
+        run_swipe(true, swipes);
+        run_swipe(false, swipes);
+        found = true;
+    }
+
+    if (!found) {
+        fprintf(stderr, "splitter_bench: unknown scene '%s'\n", scene_name);
+        fprintf(stderr, "scenes: all swipe pool budget lod bake clip threads "
+                "hasty broadphase clock sdf snapshot raster replay "
+                "replay_check slice_check");
+        for (int i = 0; i < scenes_num; i++)
+            fprintf(stderr, " %s", scenes[i].name);
+        fprintf(stderr, "\n");
+    }
+
+    log_shutdown();
+    logger_shutdown();
+    return found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
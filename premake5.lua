@@ -2,6 +2,18 @@ local sanit = false
 local inspect = require 'inspect'
 local caustic = loadfile("../caustic/caustic.lua")()
 
+-- premake5 --avx gmake2: AVX ветка в splitter_clip.c вместо SSE2
+newoption {
+    trigger = "avx",
+    description = "Build the slicing kernels with -mavx",
+}
+
+-- premake5 --profile gmake2: таймеры фаз кадра, см. src/splitter_prof.h
+newoption {
+    trigger = "profile",
+    description = "Build with the per-phase frame profiler",
+}
+
 workspace "ray_example"
     configurations { "Debug", "Release" }
 
@@ -79,7 +91,8 @@ workspace "ray_example"
             'utf8proc',
             'caustic', 
             'smallregex',
-            'm'
+            'm',
+            'pthread'
         })
         --]]
         links('lua')
@@ -91,10 +104,71 @@ workspace "ray_example"
         buildoptions { 
             "-ggdb3",
         }
-        files { 
+        files {
             "src/**.c",
         }
 
+    -- Headless бенчмарк разрезания, окно не создается.
+    project "splitter_bench"
+        libdirs(caustic.libdirs)
+        links({
+            'raylib',
+            'chipmunk',
+            'genann',
+            'utf8proc',
+            'caustic',
+            'smallregex',
+            'm',
+            'pthread'
+        })
+        links('lua')
+        includedirs {
+            "src",
+        }
+        buildoptions {
+            "-ggdb3",
+        }
+        files {
+            "src/splitter_arena.c",
+            "src/splitter_clip.c",
+            "src/splitter_core.c",
+            "src/splitter_log.c",
+            "src/splitter_planes.c",
+            "src/splitter_pool.c",
+            "src/splitter_prof.c",
+            "src/splitter_raster.c",
+            "src/splitter_replay.c",
+            "src/splitter_sdf.c",
+            "src/splitter_snapshot.c",
+            "src/splitter_workers.c",
+            "bench/splitter_bench.c",
+        }
+
+    -- Файл атласа шрифта для быстрого запуска, окно не создается.
+    project "gen_atlas"
+        libdirs(caustic.libdirs)
+        links({
+            'raylib',
+            'chipmunk',
+            'genann',
+            'utf8proc',
+            'caustic',
+            'smallregex',
+            'm',
+            'pthread'
+        })
+        links('lua')
+        includedirs {
+            "src",
+        }
+        buildoptions {
+            "-ggdb3",
+        }
+        files {
+            "src/splitter_atlas.c",
+            "tools/gen_atlas.c",
+        }
+
     --[[
     project "libcaustic"
         kind "StaticLib"
@@ -185,6 +259,14 @@ workspace "ray_example"
         }
     --]]
     
+    filter "options:avx"
+        buildoptions {
+            "-mavx",
+        }
+
+    filter "options:profile"
+        defines { "SPLITTER_PROFILE" }
+
     filter "configurations:Debug"
         defines { "DEBUG" }
         symbols "On"
@@ -0,0 +1,98 @@
+#include "splitter_arena.h"
+
+#include "koh_logger.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+static inline size_t align_up(size_t sz) {
+    return (sz + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static inline size_t header_size(void) {
+    return align_up(sizeof(struct ArenaBlock));
+}
+
+static inline char *block_data(struct ArenaBlock *block) {
+    return (char*)block + header_size();
+}
+
+static struct ArenaBlock *block_new(struct Arena *a, size_t cap) {
+    struct ArenaBlock *block = malloc(header_size() + cap);
+    if (!block) {
+        trace("block_new: out of memory, %zu bytes\n", cap);
+        exit(EXIT_FAILURE);
+    }
+    block->next = NULL;
+    block->cap = cap;
+    block->used = 0;
+    a->blocks_allocated++;
+    return block;
+}
+
+void arena_init(struct Arena *a, size_t block_size) {
+    assert(a);
+    assert(block_size > 0);
+    memset(a, 0, sizeof(*a));
+    a->block_size = align_up(block_size);
+    a->first = a->current = block_new(a, a->block_size);
+}
+
+void arena_shutdown(struct Arena *a) {
+    assert(a);
+    struct ArenaBlock *block = a->first;
+    while (block) {
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    memset(a, 0, sizeof(*a));
+}
+
+void *arena_alloc(struct Arena *a, size_t sz) {
+    assert(a);
+    assert(a->current);
+    sz = align_up(sz ? sz : 1);
+
+    struct ArenaBlock *block = a->current;
+    // Ищем дальше по цепочке блок, оставшийся с прошлых кадров
+    while (block->cap - block->used < sz) {
+        if (!block->next) {
+            size_t cap = sz > a->block_size ? sz : a->block_size;
+            block->next = block_new(a, cap);
+        }
+        block = block->next;
+        block->used = 0;
+    }
+    a->current = block;
+
+    void *ptr = block_data(block) + block->used;
+    block->used += sz;
+    a->used += sz;
+    if (a->used > a->peak)
+        a->peak = a->used;
+    return ptr;
+}
+
+void *arena_calloc(struct Arena *a, size_t num, size_t sz) {
+    void *ptr = arena_alloc(a, num * sz);
+    memset(ptr, 0, num * sz);
+    return ptr;
+}
+
+void *arena_grow(struct Arena *a, void *ptr, size_t old_sz, size_t new_sz) {
+    void *new_ptr = arena_alloc(a, new_sz);
+    if (ptr && old_sz)
+        memcpy(new_ptr, ptr, old_sz < new_sz ? old_sz : new_sz);
+    return new_ptr;
+}
+
+void arena_reset(struct Arena *a) {
+    assert(a);
+    a->current = a->first;
+    a->first->used = 0;
+    a->used = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// Линейный аллокатор на кадр: память выдается сдвигом указателя и целиком
+// возвращается arena_reset() после шага пространства. Блоки не освобождаются
+// между кадрами, поэтому в установившемся режиме обращений к куче нет.
+
+#include <stddef.h>
+
+struct ArenaBlock {
+    struct ArenaBlock   *next;
+    size_t              cap, used;
+    // Данные блока идут сразу за заголовком
+};
+
+struct Arena {
+    struct ArenaBlock   *first, *current;
+    size_t              block_size;
+    // Байт выдано с последнего сброса и максимум за все время
+    size_t              used, peak;
+    // Сколько раз пришлось выделять новый блок из кучи
+    size_t              blocks_allocated;
+};
+
+void arena_init(struct Arena *a, size_t block_size);
+void arena_shutdown(struct Arena *a);
+
+void *arena_alloc(struct Arena *a, size_t sz);
+void *arena_calloc(struct Arena *a, size_t num, size_t sz);
+// Новый участок с копией старого, старый остается занятым до сброса.
+void *arena_grow(struct Arena *a, void *ptr, size_t old_sz, size_t new_sz);
+void arena_reset(struct Arena *a);
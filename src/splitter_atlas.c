@@ -0,0 +1,230 @@
+#include "splitter_atlas.h"
+
+#include "koh_logger.h"
+#include "raylib.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ATLAS_PADDING   4
+
+static uint64_t fnv64(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static uint64_t font_hash(
+    const unsigned char *ttf, int ttf_size, int size, const char *chars
+) {
+    uint64_t h = 14695981039346656037ull;
+    h = fnv64(h, ttf, ttf_size);
+    h = fnv64(h, &size, sizeof(size));
+    h = fnv64(h, chars, strlen(chars));
+    return h;
+}
+
+static bool atlas_write(
+    const char *atlas_path, const struct AtlasHeader *h,
+    const struct AtlasGlyph *glyphs, const void *pixels
+) {
+    // Через временный файл, чтобы прерванная запись не оставила битый атлас
+    char tmp_path[512] = {0};
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", atlas_path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        trace("atlas_write: could not open %s\n", tmp_path);
+        return false;
+    }
+    size_t pixels_size = (size_t)h->width * h->height * 2;
+    bool ok = fwrite(h, sizeof(*h), 1, f) == 1 &&
+        fwrite(glyphs, sizeof(glyphs[0]), h->glyphs_num, f) ==
+            (size_t)h->glyphs_num &&
+        fwrite(pixels, pixels_size, 1, f) == 1;
+    ok = !fclose(f) && ok;
+    if (!ok || rename(tmp_path, atlas_path)) {
+        trace("atlas_write: could not write %s\n", atlas_path);
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+bool atlas_build(
+    const char *ttf_path, const char *atlas_path, int size, const char *chars
+) {
+    assert(ttf_path);
+    assert(atlas_path);
+    assert(chars);
+
+    int ttf_size = 0;
+    unsigned char *ttf = LoadFileData(ttf_path, &ttf_size);
+    if (!ttf) {
+        trace("atlas_build: could not read %s\n", ttf_path);
+        return false;
+    }
+
+    int codepoints_num = 0;
+    int *codepoints = LoadCodepoints(chars, &codepoints_num);
+    GlyphInfo *glyphs = LoadFontData(
+        ttf, ttf_size, size, codepoints, codepoints_num, FONT_DEFAULT
+    );
+    if (!glyphs) {
+        trace("atlas_build: could not rasterize %s\n", ttf_path);
+        UnloadCodepoints(codepoints);
+        UnloadFileData(ttf);
+        return false;
+    }
+
+    Rectangle *recs = NULL;
+    Image img = GenImageFontAtlas(
+        glyphs, &recs, codepoints_num, size, ATLAS_PADDING, 0
+    );
+    assert(img.format == PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA);
+
+    struct AtlasHeader h = {
+        .magic = ATLAS_MAGIC,
+        .version = ATLAS_VERSION,
+        .font_hash = font_hash(ttf, ttf_size, size, chars),
+        .size = size,
+        .padding = ATLAS_PADDING,
+        .glyphs_num = codepoints_num,
+        .width = img.width,
+        .height = img.height,
+    };
+    struct AtlasGlyph *out = calloc(codepoints_num, sizeof(out[0]));
+    assert(out);
+    for (int i = 0; i < codepoints_num; i++) {
+        out[i] = (struct AtlasGlyph) {
+            .value = glyphs[i].value,
+            .offset_x = glyphs[i].offsetX,
+            .offset_y = glyphs[i].offsetY,
+            .advance_x = glyphs[i].advanceX,
+            .x = recs[i].x,
+            .y = recs[i].y,
+            .w = recs[i].width,
+            .h = recs[i].height,
+        };
+    }
+
+    bool ok = atlas_write(atlas_path, &h, out, img.data);
+    trace(
+        "atlas_build: %s, glyphs %d, %dx%d\n",
+        atlas_path, codepoints_num, img.width, img.height
+    );
+
+    free(out);
+    UnloadImage(img);
+    MemFree(recs);
+    UnloadFontData(glyphs, codepoints_num);
+    UnloadCodepoints(codepoints);
+    UnloadFileData(ttf);
+    return ok;
+}
+
+// hash == 0 - TTF недоступен, атлас принимается без сверки
+static bool atlas_map(
+    Font *fnt, const char *atlas_path, int size, uint64_t hash
+) {
+    int fd = open(atlas_path, O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct AtlasHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t map_size = st.st_size;
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        trace("atlas_map: mmap failed for %s\n", atlas_path);
+        return false;
+    }
+
+    const struct AtlasHeader *h = map;
+    bool valid = h->magic == ATLAS_MAGIC && h->version == ATLAS_VERSION &&
+        h->size == size && (!hash || h->font_hash == hash) &&
+        h->glyphs_num > 0 && h->width > 0 && h->height > 0 &&
+        sizeof(*h) + sizeof(struct AtlasGlyph) * h->glyphs_num +
+            (size_t)h->width * h->height * 2 <= map_size;
+    if (!valid) {
+        trace("atlas_map: %s is stale or broken\n", atlas_path);
+        munmap(map, map_size);
+        return false;
+    }
+
+    const struct AtlasGlyph *g = (const struct AtlasGlyph*)(h + 1);
+    int num = h->glyphs_num;
+    memset(fnt, 0, sizeof(*fnt));
+    fnt->baseSize = h->size;
+    fnt->glyphCount = num;
+    fnt->glyphPadding = h->padding;
+    fnt->glyphs = calloc(num, sizeof(fnt->glyphs[0]));
+    fnt->recs = calloc(num, sizeof(fnt->recs[0]));
+    assert(fnt->glyphs);
+    assert(fnt->recs);
+    // Изображения глифов не нужны, рисование идет только из текстуры
+    for (int i = 0; i < num; i++) {
+        fnt->glyphs[i].value = g[i].value;
+        fnt->glyphs[i].offsetX = g[i].offset_x;
+        fnt->glyphs[i].offsetY = g[i].offset_y;
+        fnt->glyphs[i].advanceX = g[i].advance_x;
+        fnt->recs[i] = (Rectangle) { g[i].x, g[i].y, g[i].w, g[i].h };
+    }
+    fnt->texture = LoadTextureFromImage((Image) {
+        .data = (void*)(g + num),
+        .width = h->width,
+        .height = h->height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA,
+    });
+
+    trace(
+        "atlas_map: %s, glyphs %d, %dx%d\n",
+        atlas_path, num, h->width, h->height
+    );
+    munmap(map, map_size);
+    return true;
+}
+
+bool atlas_load(
+    Font *fnt, const char *ttf_path, const char *atlas_path, int size,
+    const char *chars
+) {
+    assert(fnt);
+    assert(ttf_path);
+    assert(atlas_path);
+    assert(chars);
+
+    uint64_t hash = 0;
+    int ttf_size = 0;
+    unsigned char *ttf = LoadFileData(ttf_path, &ttf_size);
+    if (ttf) {
+        hash = font_hash(ttf, ttf_size, size, chars);
+        UnloadFileData(ttf);
+    }
+
+    if (atlas_map(fnt, atlas_path, size, hash))
+        return true;
+    trace("atlas_load: rebuilding %s\n", atlas_path);
+    return atlas_build(ttf_path, atlas_path, size, chars) &&
+        atlas_map(fnt, atlas_path, size, hash);
+}
+
+void atlas_unload(Font *fnt) {
+    assert(fnt);
+    if (fnt->texture.id)
+        UnloadTexture(fnt->texture);
+    free(fnt->glyphs);
+    free(fnt->recs);
+    memset(fnt, 0, sizeof(*fnt));
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// Заранее растеризованный шрифт в файле. Файл отображается в память, пиксели
+// уходят на GPU прямо из отображения, после чего оно снимается. Атлас
+// пересобирается, если изменились TTF, размер или набор символов, см.
+// AtlasHeader.font_hash. Собрать заранее: tools/gen_atlas.c
+//
+// Формат: AtlasHeader, glyphs_num * AtlasGlyph, пиксели width * height в
+// PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA. Порядок байт платформы.
+
+#include "raylib.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ATLAS_MAGIC     0x414c5053u     // "SPLA"
+#define ATLAS_VERSION   1
+
+// Шрифт глифов разрезателя
+#define SPLITTER_FONT_TTF   "assets/fonts/VictorMono-Medium.ttf"
+#define SPLITTER_FONT_ATLAS "assets/fonts/VictorMono-Medium-455.atlas"
+#define SPLITTER_FONT_SIZE  455
+#define SPLITTER_FONT_CHARS " ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+
+struct AtlasHeader {
+    uint32_t    magic, version;
+    // FNV-1a от содержимого TTF, размера и набора символов
+    uint64_t    font_hash;
+    int32_t     size, padding, glyphs_num, width, height;
+};
+
+struct AtlasGlyph {
+    int32_t     value, offset_x, offset_y, advance_x;
+    float       x, y, w, h;
+};
+
+// chars - нужные символы в UTF-8, остальные в атлас не попадают
+bool atlas_build(
+    const char *ttf_path, const char *atlas_path, int size, const char *chars
+);
+// Пересобирает атлас, если файла нет или он устарел
+bool atlas_load(
+    Font *fnt, const char *ttf_path, const char *atlas_path, int size,
+    const char *chars
+);
+// Только для шрифта из atlas_load()
+void atlas_unload(Font *fnt);
@@ -0,0 +1,179 @@
+#include "splitter_clip.h"
+
+#include "chipmunk/chipmunk.h"
+#include <assert.h>
+#include <math.h>
+
+#if CP_USE_DOUBLES && defined(__AVX__)
+#define CLIP_AVX
+#include <immintrin.h>
+#elif CP_USE_DOUBLES && defined(__SSE2__)
+#define CLIP_SSE2
+#include <emmintrin.h>
+#endif
+
+const char *clip_kernel_name(void) {
+#if defined(CLIP_AVX)
+    return "avx";
+#elif defined(CLIP_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+void clip_transform(
+    const cpVect *verts, int count, cpTransform t, cpFloat *x, cpFloat *y
+) {
+    assert(verts);
+    assert(x);
+    assert(y);
+    int i = 0;
+#if defined(CLIP_AVX) || defined(CLIP_SSE2)
+    // Две вершины за раз: [x0 y0] [x1 y1] -> [x0 x1] [y0 y1]
+    const __m128d a = _mm_set1_pd(t.a), b = _mm_set1_pd(t.b);
+    const __m128d c = _mm_set1_pd(t.c), d = _mm_set1_pd(t.d);
+    const __m128d tx = _mm_set1_pd(t.tx), ty = _mm_set1_pd(t.ty);
+    for (; i + 2 <= count; i += 2) {
+        __m128d v0 = _mm_loadu_pd(&verts[i].x);
+        __m128d v1 = _mm_loadu_pd(&verts[i + 1].x);
+        __m128d vx = _mm_unpacklo_pd(v0, v1);
+        __m128d vy = _mm_unpackhi_pd(v0, v1);
+        __m128d wx = _mm_add_pd(
+            _mm_add_pd(_mm_mul_pd(a, vx), _mm_mul_pd(c, vy)), tx
+        );
+        __m128d wy = _mm_add_pd(
+            _mm_add_pd(_mm_mul_pd(b, vx), _mm_mul_pd(d, vy)), ty
+        );
+        _mm_storeu_pd(x + i, wx);
+        _mm_storeu_pd(y + i, wy);
+    }
+#endif
+    for (; i < count; i++) {
+        x[i] = t.a * verts[i].x + t.c * verts[i].y + t.tx;
+        y[i] = t.b * verts[i].x + t.d * verts[i].y + t.ty;
+    }
+}
+
+void clip_distances(
+    const cpFloat *x, const cpFloat *y, int count, cpVect n, cpFloat dist,
+    cpFloat *d
+) {
+    assert(x);
+    assert(y);
+    assert(d);
+    int i = 0;
+#if defined(CLIP_AVX)
+    const __m256d nx = _mm256_set1_pd(n.x), ny = _mm256_set1_pd(n.y);
+    const __m256d vdist = _mm256_set1_pd(dist);
+    for (; i + 4 <= count; i += 4) {
+        __m256d px = _mm256_loadu_pd(x + i), py = _mm256_loadu_pd(y + i);
+        __m256d r = _mm256_sub_pd(
+            _mm256_add_pd(_mm256_mul_pd(px, nx), _mm256_mul_pd(py, ny)), vdist
+        );
+        _mm256_storeu_pd(d + i, r);
+    }
+#elif defined(CLIP_SSE2)
+    const __m128d nx = _mm_set1_pd(n.x), ny = _mm_set1_pd(n.y);
+    const __m128d vdist = _mm_set1_pd(dist);
+    for (; i + 2 <= count; i += 2) {
+        __m128d px = _mm_loadu_pd(x + i), py = _mm_loadu_pd(y + i);
+        __m128d r = _mm_sub_pd(
+            _mm_add_pd(_mm_mul_pd(px, nx), _mm_mul_pd(py, ny)), vdist
+        );
+        _mm_storeu_pd(d + i, r);
+    }
+#endif
+    for (; i < count; i++)
+        d[i] = x[i] * n.x + y[i] * n.y - dist;
+}
+
+// Площадь и центр масс копятся относительно первой вершины исходного
+// многоугольника, чтобы не терять точность на больших мировых координатах.
+struct HalfAcc {
+    cpFloat ox, oy;
+    cpFloat fx, fy, px, py;
+    cpFloat cross_sum, cx, cy;
+};
+
+static inline void half_push(
+    struct ClipHalf *h, struct HalfAcc *acc, cpFloat x, cpFloat y
+) {
+    h->x[h->num] = x;
+    h->y[h->num] = y;
+    cpFloat rx = x - acc->ox, ry = y - acc->oy;
+    if (h->num) {
+        cpFloat cross = acc->px * ry - acc->py * rx;
+        acc->cross_sum += cross;
+        acc->cx += (acc->px + rx) * cross;
+        acc->cy += (acc->py + ry) * cross;
+    } else {
+        acc->fx = rx;
+        acc->fy = ry;
+    }
+    acc->px = rx;
+    acc->py = ry;
+    h->num++;
+}
+
+static inline void half_finish(struct ClipHalf *h, struct HalfAcc *acc) {
+    if (h->num > 1) {
+        cpFloat cross = acc->px * acc->fy - acc->py * acc->fx;
+        acc->cross_sum += cross;
+        acc->cx += (acc->px + acc->fx) * cross;
+        acc->cy += (acc->py + acc->fy) * cross;
+    }
+    h->area = acc->cross_sum / 2.;
+    if (acc->cross_sum != 0.) {
+        cpFloat k = 1. / (3. * acc->cross_sum);
+        h->centroid = cpv(acc->ox + acc->cx * k, acc->oy + acc->cy * k);
+    } else {
+        h->centroid = cpv(acc->ox + acc->fx, acc->oy + acc->fy);
+    }
+}
+
+bool clip_split(
+    const cpFloat *x, const cpFloat *y, int count, cpVect n, cpFloat dist,
+    cpFloat *d, struct ClipHalf *below, struct ClipHalf *above
+) {
+    assert(below);
+    assert(above);
+    if (count < 3)
+        return false;
+
+    clip_distances(x, y, count, n, dist, d);
+
+    const cpFloat eps = 1e-6;
+    bool has_below = false, has_above = false;
+    for (int i = 0; i < count; i++) {
+        has_below |= d[i] < -eps;
+        has_above |= d[i] > eps;
+    }
+    if (!has_below || !has_above)
+        return false;
+
+    struct HalfAcc acc_below = { .ox = x[0], .oy = y[0] };
+    struct HalfAcc acc_above = acc_below;
+    below->num = above->num = 0;
+
+    // Вершины на самой плоскости достаются обеим половинам
+    for (int i = 0, j = count - 1; i < count; j = i, i++) {
+        cpFloat da = d[j], db = d[i];
+        if (da <= 0.)
+            half_push(below, &acc_below, x[j], y[j]);
+        if (da >= 0.)
+            half_push(above, &acc_above, x[j], y[j]);
+
+        if (da * db < 0.) {
+            cpFloat t = fabs(da) / (fabs(da) + fabs(db));
+            cpFloat px = x[j] + (x[i] - x[j]) * t;
+            cpFloat py = y[j] + (y[i] - y[j]) * t;
+            half_push(below, &acc_below, px, py);
+            half_push(above, &acc_above, px, py);
+        }
+    }
+
+    half_finish(below, &acc_below);
+    half_finish(above, &acc_above);
+    return true;
+}
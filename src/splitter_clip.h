@@ -0,0 +1,40 @@
+#pragma once
+
+// Разрезание выпуклого многоугольника плоскостью. Вершины хранятся в SoA
+// виде (отдельно x и y), расстояния до плоскости считаются SSE2/AVX, если
+// они доступны при сборке, иначе скалярно.
+
+#include "chipmunk/chipmunk.h"
+#include <stdbool.h>
+
+// Половина многоугольника. Вызывающий выделяет x и y на count + 1 вершин.
+struct ClipHalf {
+    cpFloat *x, *y;
+    int     num;
+    // Со знаком, как у cpAreaForPoly()
+    cpFloat area;
+    cpVect  centroid;
+};
+
+// Вершины в мировые координаты за один проход, AoS в SoA.
+void clip_transform(
+    const cpVect *verts, int count, cpTransform t, cpFloat *x, cpFloat *y
+);
+
+// d[i] = n·p[i] - dist
+void clip_distances(
+    const cpFloat *x, const cpFloat *y, int count, cpVect n, cpFloat dist,
+    cpFloat *d
+);
+
+// Делит многоугольник на часть ниже плоскости (n·p - dist < 0) и выше за
+// один обход, заодно считая площадь и центр масс каждой части. d - место под
+// count расстояний. Если многоугольник не пересекает плоскость, то
+// возвращает false и половины не трогает.
+bool clip_split(
+    const cpFloat *x, const cpFloat *y, int count, cpVect n, cpFloat dist,
+    cpFloat *d, struct ClipHalf *below, struct ClipHalf *above
+);
+
+// Какой набор инструкций выбран при сборке: "avx", "sse2" или "scalar".
+const char *clip_kernel_name(void);
@@ -0,0 +1,1486 @@
+#include "splitter_core.h"
+
+#include "chipmunk/chipmunk.h"
+#include "chipmunk/chipmunk_private.h"
+#include "chipmunk/chipmunk_types.h"
+#include "chipmunk/cpHastySpace.h"
+#include "chipmunk/cpTransform.h"
+#include "chipmunk/cpVect.h"
+#include "koh_common.h"
+#include "koh_destral_ecs.h"
+#include "koh_logger.h"
+#include "splitter_clip.h"
+#include "splitter_log.h"
+#include "splitter_prof.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static cpShapeFilter GRAB_FILTER = {
+    CP_NO_GROUP, GRABBABLE_MASK_BIT, GRABBABLE_MASK_BIT
+};
+//static cpShapeFilter NOT_GRABBABLE_FILTER = {
+    //CP_NO_GROUP, ~GRABBABLE_MASK_BIT, ~GRABBABLE_MASK_BIT
+//};
+
+de_cp_type comp_body = {
+    .cp_id = 1,
+    .cp_sizeof = sizeof(struct Component_Body),
+    .name = "body",
+};
+
+de_cp_type comp_mask = {
+    .cp_id = 3,
+    .cp_sizeof = sizeof(struct Component_Mask),
+    .name = "mask",
+};
+
+static void on_destroy_mesh(void *payload, de_entity e);
+
+de_cp_type comp_mesh = {
+    .cp_id = 4,
+    .cp_sizeof = sizeof(struct Component_Mesh),
+    .name = "mesh",
+    .on_destroy = on_destroy_mesh,
+};
+
+de_cp_type comp_fragment = {
+    .cp_id = 5,
+    .cp_sizeof = sizeof(struct Component_Fragment),
+    .name = "fragment",
+};
+
+de_cp_type comp_baked = {
+    .cp_id = 6,
+    .cp_sizeof = sizeof(struct Component_Baked),
+    .name = "baked",
+};
+
+static inline void *entt2ptr(de_entity e) {
+    return (void*)(uint64_t)e;
+}
+
+static inline de_entity ptr2entt(void *p) {
+    return (uint32_t)(ptrdiff_t)p;
+}
+
+double core_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void on_destroy_mesh(void *payload, de_entity e) {
+    assert(payload);
+    struct Component_Mesh *mesh = payload;
+    // indices лежат в том же блоке памяти. Куски, удаляемые разрезом,
+    // возвращают блок в пул сами, сюда попадает только освобождение реестра.
+    free(mesh->verts);
+    mesh->verts = NULL;
+    mesh->indices = NULL;
+}
+
+// Форма выпуклая, поэтому достаточно веера из нулевой вершины. Вершины
+// заполняет вызывающий.
+static void mesh_alloc(
+    struct FragmentPool *pool, struct Component_Mesh *mesh, int num
+) {
+    int tris_num = num >= 3 ? num - 2 : 0;
+    mesh->verts = pool_mesh_alloc(pool, num, &mesh->verts_cap);
+    mesh->indices = (int*)(mesh->verts + mesh->verts_cap);
+    mesh->verts_num = num;
+    mesh->tris_num = tris_num;
+
+    for (int i = 0; i < tris_num; i++) {
+        mesh->indices[i * 3 + 0] = 0;
+        mesh->indices[i * 3 + 1] = i + 1;
+        mesh->indices[i * 3 + 2] = i + 2;
+    }
+}
+
+static void build_mesh(
+    struct FragmentPool *pool, struct Component_Mesh *mesh, cpShape *shape
+) {
+    int num = cpPolyShapeGetCount(shape);
+    mesh_alloc(pool, mesh, num);
+    for (int i = 0; i < num; i++)
+        mesh->verts[i] = cpPolyShapeGetVert(shape, i);
+}
+
+static void mesh_release(SplitterCore *core, de_entity e) {
+    struct Component_Mesh *mesh = de_try_get(core->r, e, comp_mesh);
+    if (mesh) {
+        pool_mesh_free(&core->pool, mesh->verts, mesh->verts_cap);
+        mesh->verts = NULL;
+        mesh->indices = NULL;
+    }
+}
+
+static void fragment_register(SplitterCore *core, de_entity e, cpFloat area) {
+    if (core->fragments_num == core->fragments_cap) {
+        core->fragments_cap = core->fragments_cap ? core->fragments_cap * 2 : 256;
+        core->fragments = realloc(
+            core->fragments, sizeof(core->fragments[0]) * core->fragments_cap
+        );
+        assert(core->fragments);
+    }
+    struct Component_Fragment *f = de_emplace(core->r, e, comp_fragment);
+    f->area = area;
+    f->serial = core->fragments_serial++;
+    f->slot = core->fragments_num;
+    f->asleep = 0.;
+    core->fragments[core->fragments_num++] = e;
+}
+
+static void fragment_unregister(SplitterCore *core, de_entity e) {
+    struct Component_Fragment *f = de_try_get(core->r, e, comp_fragment);
+    if (!f)
+        return;
+    int slot = f->slot;
+    assert(slot >= 0 && slot < core->fragments_num);
+    assert(core->fragments[slot] == e);
+
+    de_entity last = core->fragments[--core->fragments_num];
+    core->fragments[slot] = last;
+    if (last != e) {
+        struct Component_Fragment *f_last = de_get(core->r, last, comp_fragment);
+        f_last->slot = slot;
+    }
+}
+
+// verts в мировых координатах, тело ставится в centroid. Момент считается
+// заранее, относительно центра масс.
+static void create_poly(
+    SplitterCore *core, de_entity e,
+    cpVect *verts, int vertsnum,
+    cpFloat area, cpVect centroid, cpFloat moment
+) {
+    cpSpace *space = core->space;
+    de_ecs *r = core->r;
+    assert(space);
+    assert(verts);
+    assert(r);
+    assert(de_valid(r, e));
+    struct Component_Body *b = de_emplace(r, e, comp_body);
+    b->has_prev = false;
+
+    cpFloat mass = area * DENSITY;
+    LOG_DEBUG("create_poly: mass %f\n", mass);
+    cpTransform transform = cpTransformTranslate(cpvneg(centroid));
+
+    b->b = pool_body_new(&core->pool, mass, moment);
+    b->b->userData = entt2ptr(e);
+    cpShape *shape = pool_poly_new(
+        &core->pool, b->b, vertsnum, verts, transform, 0.
+    );
+    //b->shape = shape;
+    cpSpaceAddBody(space, b->b);
+    cpSpaceAddShape(space, shape);
+
+    build_mesh(&core->pool, de_emplace(r, e, comp_mesh), shape);
+    fragment_register(core, e, area);
+}
+
+static void create_circle(
+    de_entity e, cpSpace *space, de_ecs *r, cpVect center, float radius
+) {
+    assert(space);
+    assert(r);
+    /*const int vertsnum = sizeof(verts) / sizeof(verts[0]);*/
+    /*create_poly(e, space, r, verts, vertsnum, cpTransformIdentity);*/
+    /*struct Component_Body *b = de_get(r, e, comp_body);*/
+    /*cpBodySetPosition(b->b, center);*/
+}
+
+de_entity core_create_box(SplitterCore *core, cpVect center, cpVect wh) {
+    assert(core);
+    assert(core->space);
+    assert(core->r);
+    float w = wh.x, h = wh.y;
+    cpVect verts[4] = {
+        { -w / 2., h / 2.},
+        { -w / 2., -h / 2.},
+        { w / 2., -h / 2.},
+        { w / 2., h / 2.},
+    };
+    const int vertsnum = sizeof(verts) / sizeof(verts[0]);
+    de_entity e = de_create(core->r);
+    cpFloat area = cpAreaForPoly(vertsnum, verts, 0.);
+    cpFloat moment = cpMomentForPoly(
+        area * DENSITY, vertsnum, verts, cpvzero, 0.
+    );
+    create_poly(core, e, verts, vertsnum, area, cpvzero, moment);
+    struct Component_Body *b = de_get(core->r, e, comp_body);
+    cpBodySetPosition(b->b, center);
+
+    struct Component_Mask *m = de_emplace(core->r, e, comp_mask);
+    m->tr = cpTransformIdentity;
+    m->size = wh;
+    m->planes.num = 0;
+    return e;
+}
+
+struct ShapeCopyCtx {
+    float friction;
+};
+
+static void iter_shape_copy(cpBody *body, cpShape *shape, void *data) {
+    struct ShapeCopyCtx *ctx = data;
+    cpShapeSetFriction(shape, ctx->friction);
+}
+
+// Плоскость разреза, внутри то, для чего cpvdot(n, p) - dist < 0
+struct SlicePlane {
+    cpVect  n;
+    cpFloat dist;
+};
+
+// Выпуклый кусок разрезаемой формы в мировых координатах и плоскости,
+// которыми он был отсечен. Вершины в SoA виде для splitter_clip.
+struct SlicePiece {
+    cpFloat             *x, *y;
+    int                 num;
+    cpFloat             area;
+    cpVect              centroid;
+    struct SlicePlane   *planes;
+    int                 planes_num;
+    // Заполняются только у готовых кусков, см. slice_compute()
+    cpVect              *verts;
+    cpFloat             moment;
+};
+
+struct SliceTarget {
+    cpShape     *shape;
+    cpBody      *body;
+    de_entity   e;
+};
+
+// Разрез одной формы. Геометрия считается в пуле потоков и только читает
+// пространство, создание тел и сущностей потом идет в главном потоке.
+struct SliceJob {
+    struct SliceTarget  target;
+    const cpVect        *mesh_verts;
+    int                 mesh_num;
+    cpTransform         body2world;
+    struct SlicePiece   *pieces;
+    int                 pieces_num;
+};
+
+struct SliceWork {
+    SplitterCore        *core;
+    struct SliceJob     *jobs;
+    const cpVect        *pts;
+    int                 pts_num;
+};
+
+// Один разрез ломаной: все задетые формы собираются запросами до шага,
+// а режутся и попадают в пространство одним post-step вызовом.
+struct SliceBatch {
+    cpVect              *pts;
+    int                 pts_num;
+    struct SliceTarget  *targets;
+    int                 targets_num, targets_cap;
+};
+
+static de_entity create_fragment(
+    SplitterCore *core, cpShape *shape, const struct SlicePiece *piece,
+    cpTransform *body2world
+) {
+    cpBody *body = cpShapeGetBody(shape);
+    de_ecs *r = core->r;
+    cpVect centroid = piece->centroid;
+
+    de_entity e = de_create(r);
+    create_poly(
+        core, e, piece->verts, piece->num, piece->area, centroid, piece->moment
+    );
+    struct Component_Body* b = de_get(r, e, comp_body);
+    assert(b);
+
+    cpBodySetPosition(b->b, centroid);
+    cpBodySetVelocity(b->b, cpBodyGetVelocityAtWorldPoint(body, centroid));
+    cpBodySetAngularVelocity(b->b, cpBodyGetAngularVelocity(body));
+
+    // Copy whatever properties you have set on the original shape that are important
+    struct ShapeCopyCtx ctx_copy = {
+        .friction = cpShapeGetFriction(shape),
+    };
+    cpBodyEachShape(b->b, iter_shape_copy, &ctx_copy);
+    *body2world = b->b->transform;
+    return e;
+}
+
+static void particle_free(SplitterCore *core, int i) {
+    assert(i >= 0 && i < core->particles_num);
+    de_entity e = core->particles[i].e;
+    if (de_valid(core->r, e)) {
+        mesh_release(core, e);
+        de_destroy(core->r, e);
+    }
+    core->particles[i] = core->particles[--core->particles_num];
+}
+
+// Свободная ячейка массива частиц, при заполнении освобождает ту, которой
+// осталось жить меньше всех.
+static struct Particle *particle_slot(SplitterCore *core) {
+    int max = core->lod.max_particles;
+    if (max > 0 && core->particles_num >= max) {
+        int oldest = 0;
+        for (int i = 1; i < core->particles_num; i++)
+            if (core->particles[i].life < core->particles[oldest].life)
+                oldest = i;
+        particle_free(core, oldest);
+        core->stats.particles_expired++;
+    }
+    if (core->particles_num == core->particles_cap) {
+        core->particles_cap = core->particles_cap ? core->particles_cap * 2 : 256;
+        core->particles = realloc(
+            core->particles, sizeof(core->particles[0]) * core->particles_cap
+        );
+        assert(core->particles);
+    }
+    return &core->particles[core->particles_num++];
+}
+
+static de_entity create_particle(
+    SplitterCore *core, cpBody *body, const struct SlicePiece *piece,
+    cpTransform *body2world
+) {
+    de_ecs *r = core->r;
+    cpVect centroid = piece->centroid;
+    de_entity e = de_create(r);
+
+    struct Component_Mesh *mesh = de_emplace(r, e, comp_mesh);
+    mesh_alloc(&core->pool, mesh, piece->num);
+    for (int i = 0; i < piece->num; i++)
+        mesh->verts[i] = cpvsub(piece->verts[i], centroid);
+
+    struct Particle *pt = particle_slot(core);
+    *pt = (struct Particle) {
+        .e = e,
+        .p = centroid,
+        .v = cpBodyGetVelocityAtWorldPoint(body, centroid),
+        .a = 0.,
+        .w = cpBodyGetAngularVelocity(body),
+        .life = core->lod.lifetime,
+    };
+    core->stats.particles_spawned++;
+    *body2world = particle_transform(pt);
+    return e;
+}
+
+// Без столкновений и ограничений, только гравитация и затухание
+// пространства.
+static void particles_update(SplitterCore *core, double dt) {
+    cpVect g = cpvmult(cpSpaceGetGravity(core->space), dt);
+    cpFloat damping = cpfpow(cpSpaceGetDamping(core->space), dt);
+    for (int i = 0; i < core->particles_num;) {
+        struct Particle *pt = &core->particles[i];
+        pt->life -= dt;
+        if (pt->life <= 0.) {
+            particle_free(core, i);
+            core->stats.particles_expired++;
+            continue;
+        }
+        pt->v = cpvmult(cpvadd(pt->v, g), damping);
+        pt->w *= damping;
+        pt->p = cpvadd(pt->p, cpvmult(pt->v, dt));
+        pt->a += pt->w * dt;
+        i++;
+    }
+}
+
+// Кусок наследует маску родителя с добавленными плоскостями разрезов.
+static void inherit_mask(
+    de_ecs *r, de_entity e_new, cpTransform new_body2world,
+    de_entity e_old, cpBody *old_body,
+    const struct SlicePlane *planes, int planes_num
+) {
+    struct Component_Mask *m_old = de_try_get(r, e_old, comp_mask);
+    if (!m_old)
+        return;
+    // de_emplace может переместить хранилище компонента
+    struct Component_Mask m = *m_old;
+
+    cpTransform glyph2world = cpTransformMult(old_body->transform, m.tr);
+    m.tr = cpTransformMult(cpTransformInverse(new_body2world), glyph2world);
+
+    struct Component_Mesh *mesh = de_get(r, e_new, comp_mesh);
+    assert(mesh);
+    int num = mesh->verts_num;
+    cpVect verts[num];
+    cpTransform body2glyph = cpTransformInverse(m.tr);
+    for (int i = 0; i < num; i++)
+        verts[i] = cpTransformPoint(body2glyph, mesh->verts[i]);
+
+    // Унаследованные плоскости сначала проверяются по новому куску, чтобы
+    // при переполнении не вытеснить ограничивающую
+    planes_prune(&m.planes, verts, num);
+    for (int i = 0; i < planes_num; i++)
+        planes_add_world(
+            &m.planes, glyph2world, planes[i].n, planes[i].dist, verts, num
+        );
+    planes_prune(&m.planes, verts, num);
+
+    *(struct Component_Mask*)de_emplace(r, e_new, comp_mask) = m;
+}
+
+static void destroy_fragment(SplitterCore *core, de_entity e, cpBody *body) {
+    cpSpace *space = core->space;
+    de_ecs *r = core->r;
+
+    // Тело с единственной формой, см. create_poly
+    cpShape *shape = body->shapeList;
+    cpSpaceRemoveShape(space, shape);
+    cpSpaceRemoveBody(space, body);
+    pool_shape_free(&core->pool, shape);
+    pool_body_free(&core->pool, body);
+
+    if (de_valid(r, e)) {
+        LOG_DEBUG("destroy_fragment: de_destroy %lu\n", (unsigned long)e);
+        mesh_release(core, e);
+        fragment_unregister(core, e);
+        de_destroy(r, e);
+        core->stats.fragments_destroyed++;
+    }
+}
+
+// Переносит уснувший кусок в статический слой. Вызывается вне шага.
+static void bake_fragment(SplitterCore *core, de_entity e) {
+    de_ecs *r = core->r;
+    cpSpace *space = core->space;
+    struct Component_Body *b = de_get(r, e, comp_body);
+    struct Component_Mesh *mesh = de_get(r, e, comp_mesh);
+    cpBody *body = b->b;
+    cpShape *shape = body->shapeList;
+    cpTransform body2world = body->transform;
+
+    cpVect verts[mesh->verts_num];
+    for (int i = 0; i < mesh->verts_num; i++)
+        verts[i] = cpTransformPoint(body2world, mesh->verts[i]);
+    cpShape *baked = pool_poly_new(
+        &core->pool, core->static_layer, mesh->verts_num, verts,
+        cpTransformIdentity, 0.
+    );
+    cpShapeSetFriction(baked, cpShapeGetFriction(shape));
+    cpShapeSetCollisionType(baked, COLLISION_BAKED);
+    cpShapeSetUserData(baked, entt2ptr(e));
+    cpSpaceAddShape(space, baked);
+
+    cpSpaceRemoveShape(space, shape);
+    cpSpaceRemoveBody(space, body);
+    pool_shape_free(&core->pool, shape);
+    pool_body_free(&core->pool, body);
+
+    de_remove(r, e, comp_body);
+    struct Component_Baked *bk = de_emplace(r, e, comp_baked);
+    bk->shape = baked;
+    bk->body2world = body2world;
+    core->baked_version++;
+    core->stats.fragments_baked++;
+}
+
+// Возвращает запеченный кусок в динамику с тем же положением, маска и
+// триангуляция в локальной системе не меняются.
+static cpBody *unbake_fragment(SplitterCore *core, de_entity e) {
+    de_ecs *r = core->r;
+    cpSpace *space = core->space;
+    struct Component_Baked bk = *(struct Component_Baked*)de_get(r, e, comp_baked);
+    struct Component_Mesh *mesh = de_get(r, e, comp_mesh);
+    struct Component_Fragment *f = de_get(r, e, comp_fragment);
+
+    cpFloat mass = f->area * DENSITY;
+    cpFloat moment = cpMomentForPoly(
+        mass, mesh->verts_num, mesh->verts, cpvzero, 0.
+    );
+    cpBody *body = pool_body_new(&core->pool, mass, moment);
+    body->userData = entt2ptr(e);
+    cpShape *shape = pool_poly_new(
+        &core->pool, body, mesh->verts_num, mesh->verts,
+        cpTransformIdentity, 0.
+    );
+    cpShapeSetFriction(shape, cpShapeGetFriction(bk.shape));
+    cpBodySetAngle(body, atan2(bk.body2world.b, bk.body2world.a));
+    cpBodySetPosition(body, cpv(bk.body2world.tx, bk.body2world.ty));
+    cpSpaceAddBody(space, body);
+    cpSpaceAddShape(space, shape);
+
+    cpSpaceRemoveShape(space, bk.shape);
+    pool_shape_free(&core->pool, bk.shape);
+
+    de_remove(r, e, comp_baked);
+    struct Component_Body *b = de_emplace(r, e, comp_body);
+    b->b = body;
+    b->has_prev = false;
+    f->asleep = 0.;
+    core->baked_version++;
+    core->stats.fragments_unbaked++;
+    return body;
+}
+
+static void destroy_baked(SplitterCore *core, de_entity e) {
+    struct Component_Baked *bk = de_get(core->r, e, comp_baked);
+    cpSpaceRemoveShape(core->space, bk->shape);
+    pool_shape_free(&core->pool, bk->shape);
+    mesh_release(core, e);
+    fragment_unregister(core, e);
+    de_destroy(core->r, e);
+    core->baked_version++;
+    core->stats.fragments_destroyed++;
+}
+
+static void UnbakePostStep(cpSpace *space, cpShape *shape, void *unused) {
+    SplitterCore *core = space->userData;
+    de_entity e = ptr2entt(cpShapeGetUserData(shape));
+    if (!de_valid(core->r, e))
+        return;
+    // Форму могли уже вернуть или разрезать за этот шаг
+    struct Component_Baked *bk = de_try_get(core->r, e, comp_baked);
+    if (bk && bk->shape == shape)
+        unbake_fragment(core, e);
+}
+
+static cpBool on_baked_begin(cpArbiter *arb, cpSpace *space, void *udata) {
+    SplitterCore *core = udata;
+    cpShape *baked, *other;
+    cpArbiterGetShapes(arb, &baked, &other);
+    cpBody *body = cpShapeGetBody(other);
+    if (cpBodyGetType(body) != CP_BODY_TYPE_DYNAMIC)
+        return cpTrue;
+    // Соседи по куче касаются слоя постоянно, будят только удары
+    if (cpvlength(cpBodyGetVelocity(body)) > core->bake.wake_speed)
+        cpSpaceAddPostStepCallback(
+            space, (cpPostStepFunc)UnbakePostStep, baked, NULL
+        );
+    return cpTrue;
+}
+
+static void bake_sleeping(SplitterCore *core, double dt) {
+    if (!core->bake.enabled)
+        return;
+    // Удаление тела из пространства будит всю спящую группу, поэтому
+    // сначала собираются все готовые куски, потом запекаются разом.
+    de_entity *ready = arena_alloc(
+        &core->frame_arena, sizeof(ready[0]) * (core->fragments_num + 1)
+    );
+    int ready_num = 0;
+    for (int i = 0; i < core->fragments_num; i++) {
+        de_entity e = core->fragments[i];
+        struct Component_Body *b = de_try_get(core->r, e, comp_body);
+        if (!b)
+            continue;
+        struct Component_Fragment *f = de_get(core->r, e, comp_fragment);
+        if (!cpBodyIsSleeping(b->b)) {
+            f->asleep = 0.;
+            continue;
+        }
+        f->asleep += dt;
+        if (f->asleep >= core->bake.sleep_time)
+            ready[ready_num++] = e;
+    }
+    // bake_fragment() не меняет реестр
+    for (int i = 0; i < ready_num; i++)
+        bake_fragment(core, ready[i]);
+}
+
+// Хорды, по которым ломаная проходит форму насквозь. Ломаная, которая
+// начинается или заканчивается внутри формы, ее не режет.
+static int collect_cuts(
+    cpShape *shape, const cpVect *pts, int pts_num, struct SlicePlane *cuts
+) {
+    int cuts_num = 0;
+    bool has_entry = false;
+    cpVect entry = cpvzero;
+
+    for (int k = 0; k + 1 < pts_num; k++) {
+        cpVect a = pts[k], b = pts[k + 1];
+        bool a_in = cpShapePointQuery(shape, a, NULL) < 0.;
+        bool b_in = cpShapePointQuery(shape, b, NULL) < 0.;
+        cpSegmentQueryInfo info;
+        cpVect from, to;
+
+        if (!a_in && !b_in) {
+            if (!cpShapeSegmentQuery(shape, a, b, 0., &info))
+                continue;
+            from = a;
+            to = b;
+        } else if (!a_in && b_in) {
+            if (cpShapeSegmentQuery(shape, a, b, 0., &info)) {
+                entry = info.point;
+                has_entry = true;
+            }
+            continue;
+        } else if (a_in && !b_in) {
+            if (!has_entry || !cpShapeSegmentQuery(shape, b, a, 0., &info))
+                continue;
+            from = entry;
+            to = info.point;
+            has_entry = false;
+        } else {
+            continue;
+        }
+
+        if (cpvdistsq(from, to) < 1e-6)
+            continue;
+
+        // Clipping plane normal and distance.
+        cpVect n = cpvnormalize(cpvperp(cpvsub(to, from)));
+        cuts[cuts_num].n = n;
+        cuts[cuts_num].dist = cpvdot(from, n);
+        cuts_num++;
+    }
+
+    return cuts_num;
+}
+
+static struct SlicePiece piece_new(
+    struct Arena *arena, int verts_cap, int planes_cap
+) {
+    struct SlicePiece piece = {
+        .x = arena_alloc(arena, sizeof(cpFloat) * verts_cap),
+        .y = arena_alloc(arena, sizeof(cpFloat) * verts_cap),
+        .planes = arena_alloc(arena, sizeof(struct SlicePlane) * planes_cap),
+    };
+    return piece;
+}
+
+static void piece_inherit_planes(
+    struct SlicePiece *half, const struct SlicePiece *piece,
+    struct SlicePlane cut
+) {
+    memcpy(
+        half->planes, piece->planes, sizeof(piece->planes[0]) * piece->planes_num
+    );
+    half->planes_num = piece->planes_num;
+    half->planes[half->planes_num++] = cut;
+}
+
+// Обе половины за один проход. false, если плоскость кусок не делит.
+static bool piece_split(
+    struct Arena *arena, const struct SlicePiece *piece, struct SlicePlane cut,
+    int planes_cap, cpFloat *d, struct SlicePiece *below, struct SlicePiece *above
+) {
+    *below = piece_new(arena, piece->num + 1, planes_cap);
+    *above = piece_new(arena, piece->num + 1, planes_cap);
+    struct ClipHalf h_below = { .x = below->x, .y = below->y };
+    struct ClipHalf h_above = { .x = above->x, .y = above->y };
+    if (!clip_split(
+        piece->x, piece->y, piece->num, cut.n, cut.dist, d, &h_below, &h_above
+    ))
+        return false;
+    if (h_below.num < 3 || h_above.num < 3)
+        return false;
+
+    below->num = h_below.num;
+    below->area = h_below.area;
+    below->centroid = h_below.centroid;
+    above->num = h_above.num;
+    above->area = h_above.area;
+    above->centroid = h_above.centroid;
+    piece_inherit_planes(below, piece, cut);
+    piece_inherit_planes(
+        above, piece, (struct SlicePlane) { cpvneg(cut.n), -cut.dist }
+    );
+    return true;
+}
+
+static cpVect *piece_verts(struct Arena *arena, const struct SlicePiece *piece) {
+    cpVect *verts = arena_alloc(arena, sizeof(cpVect) * piece->num);
+    for (int i = 0; i < piece->num; i++)
+        verts[i] = cpv(piece->x[i], piece->y[i]);
+    return verts;
+}
+
+static struct Arena *worker_arena(SplitterCore *core, int worker) {
+    return worker ? &core->worker_arenas[worker - 1] : &core->frame_arena;
+}
+
+// Проверка и подготовка цели в главном потоке. Запеченный кусок
+// возвращается в динамику, чтобы его можно было разрезать как обычный.
+static bool slice_prepare(
+    SplitterCore *core, const struct SliceTarget *target, struct SliceJob *job
+) {
+    de_ecs *r = core->r;
+    cpShape *shape = target->shape;
+    cpBody *body = target->body;
+
+    // Форма могла быть уже разрезана или удалена за этот шаг
+    if (!de_valid(r, target->e))
+        return false;
+    if (body == core->static_layer) {
+        struct Component_Baked *bk = de_try_get(r, target->e, comp_baked);
+        if (!bk || bk->shape != shape)
+            return false;
+        body = unbake_fragment(core, target->e);
+        shape = body->shapeList;
+    } else {
+        struct Component_Body *b = de_try_get(r, target->e, comp_body);
+        if (!b || b->b != body)
+            return false;
+    }
+
+    // Триангуляция хранит те же вершины, что и форма
+    struct Component_Mesh *mesh = de_get(r, target->e, comp_mesh);
+    *job = (struct SliceJob) {
+        .target = { .shape = shape, .body = body, .e = target->e },
+        .mesh_verts = mesh->verts,
+        .mesh_num = mesh->verts_num,
+        .body2world = body->transform,
+    };
+    return true;
+}
+
+// Выполняется в пуле потоков: только чтение формы и арена потока.
+static void slice_compute(void *udata, int index, int worker) {
+    struct SliceWork *work = udata;
+    struct SliceJob *job = &work->jobs[index];
+    struct Arena *arena = worker_arena(work->core, worker);
+    int pts_num = work->pts_num;
+
+    struct SlicePlane *cuts = arena_alloc(arena, sizeof(cuts[0]) * pts_num);
+    int cuts_num = collect_cuts(job->target.shape, work->pts, pts_num, cuts);
+    if (!cuts_num)
+        return;
+
+    int count = job->mesh_num;
+    int pieces_num = 1, pieces_cap = 4;
+    struct SlicePiece *pieces = arena_alloc(arena, sizeof(pieces[0]) * pieces_cap);
+    pieces[0] = piece_new(arena, count, cuts_num);
+    pieces[0].num = count;
+    pieces[0].planes_num = 0;
+    clip_transform(
+        job->mesh_verts, count, job->body2world, pieces[0].x, pieces[0].y
+    );
+
+    // Куски только уменьшаются, вершин не больше count + cuts_num
+    cpFloat *d = arena_alloc(arena, sizeof(cpFloat) * (count + cuts_num));
+
+    for (int c = 0; c < cuts_num; c++) {
+        int num = pieces_num;
+        for (int p = 0; p < num; p++) {
+            struct SlicePiece half1, half2;
+            if (!piece_split(
+                arena, &pieces[p], cuts[c], cuts_num, d, &half1, &half2
+            ))
+                continue;
+
+            if (pieces_num == pieces_cap) {
+                pieces = arena_grow(
+                    arena, pieces, sizeof(pieces[0]) * pieces_cap,
+                    sizeof(pieces[0]) * pieces_cap * 2
+                );
+                pieces_cap *= 2;
+            }
+            pieces[p] = half1;
+            pieces[pieces_num++] = half2;
+        }
+    }
+
+    if (pieces_num < 2)
+        return;
+
+    for (int p = 0; p < pieces_num; p++) {
+        struct SlicePiece *piece = &pieces[p];
+        piece->verts = piece_verts(arena, piece);
+        piece->moment = cpMomentForPoly(
+            piece->area * DENSITY, piece->num, piece->verts,
+            cpvneg(piece->centroid), 0.
+        );
+    }
+    job->pieces = pieces;
+    job->pieces_num = pieces_num;
+}
+
+static void slice_commit(SplitterCore *core, struct SliceJob *job) {
+    if (job->pieces_num < 2)
+        return;
+
+    de_ecs *r = core->r;
+    cpShape *shape = job->target.shape;
+    cpBody *body = job->target.body;
+    de_entity e_old = job->target.e;
+
+    for (int p = 0; p < job->pieces_num; p++) {
+        const struct SlicePiece *piece = &job->pieces[p];
+        cpTransform body2world;
+        de_entity e_new = cpfabs(piece->area) < core->lod.min_area ?
+            create_particle(core, body, piece, &body2world) :
+            create_fragment(core, shape, piece, &body2world);
+        inherit_mask(
+            r, e_new, body2world, e_old, body,
+            piece->planes, piece->planes_num
+        );
+        if (core->hooks.on_fragment)
+            core->hooks.on_fragment(core, e_new, e_old, body);
+    }
+    core->stats.shapes_cut++;
+    core->stats.fragments_created += job->pieces_num;
+    destroy_fragment(core, e_old, body);
+}
+
+static void SliceBatchPostStep(
+    cpSpace *space, struct SliceBatch *batch, void *unused
+) {
+    SplitterCore *core = space->userData;
+    PROF_BEGIN(PROF_POSTSTEP);
+    double time_start = core_time();
+
+    struct SliceJob *jobs = arena_alloc(
+        &core->frame_arena, sizeof(jobs[0]) * batch->targets_num
+    );
+    int jobs_num = 0;
+    for (int i = 0; i < batch->targets_num; i++)
+        if (slice_prepare(core, &batch->targets[i], &jobs[jobs_num]))
+            jobs_num++;
+
+    struct SliceWork work = {
+        .core = core,
+        .jobs = jobs,
+        .pts = batch->pts,
+        .pts_num = batch->pts_num,
+    };
+    workers_run(&core->workers, slice_compute, &work, jobs_num);
+
+    for (int i = 0; i < jobs_num; i++)
+        slice_commit(core, &jobs[i]);
+
+    if (core->hooks.on_poststep)
+        core->hooks.on_poststep(core, core_time() - time_start);
+    PROF_END(PROF_POSTSTEP);
+}
+
+static void
+SliceQuery(
+    cpShape *shape, cpVect point, cpVect normal, cpFloat alpha,
+    struct SliceBatch *batch
+)
+{
+    if (shape->klass->type != CP_POLY_SHAPE) {
+        return;
+    }
+
+    if (batch->targets_num == batch->targets_cap) {
+        SplitterCore *core = shape->space->userData;
+        int cap = batch->targets_cap ? batch->targets_cap * 2 : 16;
+        batch->targets = arena_grow(
+            &core->frame_arena, batch->targets,
+            sizeof(batch->targets[0]) * batch->targets_cap,
+            sizeof(batch->targets[0]) * cap
+        );
+        batch->targets_cap = cap;
+    }
+
+    cpBody *body = cpShapeGetBody(shape);
+    // У форм статического слоя сущность записана в самой форме
+    void *udata = cpBodyGetType(body) == CP_BODY_TYPE_STATIC ?
+        cpShapeGetUserData(shape) : body->userData;
+    batch->targets[batch->targets_num++] = (struct SliceTarget) {
+        .shape = shape,
+        .body = body,
+        .e = ptr2entt(udata),
+    };
+}
+
+// Оставляет первое попадание каждой формы в порядке запросов. Адреса форм
+// влияют только на раскладку множества, но не на порядок резки, иначе
+// сущности, серийные номера и вытеснение зависели бы от кучи.
+static void targets_dedup(SplitterCore *core, struct SliceBatch *batch) {
+    if (batch->targets_num < 2)
+        return;
+
+    int cap = 16;
+    while (cap < batch->targets_num * 2)
+        cap *= 2;
+    const cpShape **seen = arena_calloc(&core->frame_arena, cap, sizeof(*seen));
+
+    int j = 0;
+    for (int i = 0; i < batch->targets_num; i++) {
+        const cpShape *shape = batch->targets[i].shape;
+        uint64_t hash = (uint64_t)(uintptr_t)shape * 0x9E3779B97F4A7C15ULL;
+        int k = hash >> 40 & (cap - 1);
+        while (seen[k] && seen[k] != shape)
+            k = (k + 1) & (cap - 1);
+        if (seen[k])
+            continue;
+        seen[k] = shape;
+        batch->targets[j++] = batch->targets[i];
+    }
+    batch->targets_num = j;
+}
+
+void core_slice_polyline(SplitterCore *core, const cpVect *pts, int pts_num) {
+    assert(core);
+    assert(core->space);
+    assert(pts);
+    if (pts_num < 2)
+        return;
+
+    // Живет до сброса арены после шага, в котором выполнится post-step
+    struct SliceBatch *batch = arena_calloc(&core->frame_arena, 1, sizeof(*batch));
+    batch->pts_num = pts_num;
+    batch->pts = arena_alloc(&core->frame_arena, sizeof(pts[0]) * pts_num);
+    memcpy(batch->pts, pts, sizeof(pts[0]) * pts_num);
+
+    core->stats.slices++;
+    for (int i = 0; i + 1 < pts_num; i++) {
+        if (core->hooks.on_slice)
+            core->hooks.on_slice(core, pts[i], pts[i + 1]);
+        // Can't modify the space during a query.
+        cpSpaceSegmentQuery(
+            core->space, pts[i], pts[i + 1], 0.0, GRAB_FILTER,
+            (cpSpaceSegmentQueryFunc)SliceQuery, batch
+        );
+    }
+
+    LOG_DEBUG(
+        "core_slice_polyline: points %d, from %s to %s\n",
+        pts_num, cpVect_tostr(pts[0]), cpVect_tostr(pts[pts_num - 1])
+    );
+
+    // Каждая форма режется один раз, сколько бы отрезков ее ни задело
+    targets_dedup(core, batch);
+
+    if (!batch->targets_num)
+        return;
+
+    // Запросы уже отпустили пространство: режется сразу, до возврата.
+    // Post-step нужен только при вызове изнутри шага или запроса, иначе
+    // разрез ждал бы следующего шага, а его цели могли бы смениться.
+    if (core->space->locked)
+        cpSpaceAddPostStepCallback(
+            core->space, (cpPostStepFunc)SliceBatchPostStep, batch, NULL
+        );
+    else
+        SliceBatchPostStep(core->space, batch, NULL);
+}
+
+void core_slice(SplitterCore *core, cpVect from, cpVect to) {
+    cpVect pts[2] = { from, to };
+    core_slice_polyline(core, pts, 2);
+}
+
+void core_create_floor_and_walls(SplitterCore *core) {
+    assert(core);
+    cpSpace *space = core->space;
+    const float radius = 1.;
+    cpVect a = { 100, 1000 }, b = { 1920 - 100, 1000 };
+    float wall_height = 100.;
+    //float mass = 100;
+    //float moment = cpMomentForSegment(mass, a, b, radius);
+    cpBody *body = cpBodyNewStatic();
+    cpShape *segment = cpSegmentShapeNew(body, a, b, radius);
+    cpSpaceAddBody(space, body);
+    cpBodyAddShape(body, segment);
+    cpSpaceAddShape(space, segment);
+
+    body = cpBodyNewStatic();
+    segment = cpSegmentShapeNew(
+        body, a, (cpVect) { a.x, a.y - wall_height}, radius
+    );
+    cpSpaceAddBody(space, body);
+    cpBodyAddShape(body, segment);
+    cpSpaceAddShape(space, segment);
+
+    body = cpBodyNewStatic();
+    segment = cpSegmentShapeNew(
+        body, b, (cpVect) { b.x, b.y - wall_height}, radius
+    );
+    cpSpaceAddBody(space, body);
+    cpBodyAddShape(body, segment);
+    cpSpaceAddShape(space, segment);
+}
+
+static void create_cp(SplitterCore *core) {
+    // При одном потоке решатель hasty пространства работает как обычный
+    cpSpace *space = core->space = cpHastySpaceNew();
+    cpHastySpaceSetThreads(space, 1);
+    space->userData = core;
+    cpSpaceSetIterations(space, 30);
+    //cpSpaceSetGravity(space, cpv(0, -500));
+    cpSpaceSetSleepTimeThreshold(space, 0.5f);
+    cpSpaceSetCollisionSlop(space, 0.5f);
+    trace("create_cp: space dumping %f\n", cpSpaceGetDamping(space));
+    cpSpaceSetDamping(space, 0.9);
+
+    core->static_layer = cpSpaceGetStaticBody(space);
+    cpCollisionHandler *handler = cpSpaceAddWildcardHandler(
+        space, COLLISION_BAKED
+    );
+    handler->beginFunc = on_baked_begin;
+    handler->userData = core;
+}
+
+void core_diagonal_slice(SplitterCore *core, de_entity e) {
+    assert(core);
+    struct Component_Body *b = de_try_get(core->r, e, comp_body);
+    assert(b);
+
+    cpShape *shape = b->b->shapeList;
+    assert(shape->next == NULL);
+    //trace("diagonal_slice: %p, %p\n", shape, shape->next);
+    cpBB bb = cpShapeGetBB(shape);
+    cpVect half_abit = {
+        .x = (bb.r - bb.l) / 2. + 10.,
+        .y = (bb.t - bb.b) / 2. + 10.,
+    };
+    core_step(core, 1 / 60.);
+    core_slice(core, cpvsub(b->b->p, half_abit), cpvadd(b->b->p, half_abit));
+    //cpSpaceStep(space, 1 / 60.);
+}
+
+struct FragmentState core_fragment_state(SplitterCore *core, de_entity e) {
+    assert(core);
+    de_ecs *r = core->r;
+    struct Component_Fragment *f = de_get(r, e, comp_fragment);
+    struct FragmentState s = {
+        .area = f->area,
+        .serial = f->serial,
+        .asleep = f->asleep,
+    };
+    struct Component_Baked *bk = de_try_get(r, e, comp_baked);
+    if (bk) {
+        s.p = cpv(bk->body2world.tx, bk->body2world.ty);
+        s.a = atan2(bk->body2world.b, bk->body2world.a);
+        s.friction = cpShapeGetFriction(bk->shape);
+        s.baked = true;
+        return s;
+    }
+    struct Component_Body *b = de_get(r, e, comp_body);
+    s.p = cpBodyGetPosition(b->b);
+    s.v = cpBodyGetVelocity(b->b);
+    s.a = cpBodyGetAngle(b->b);
+    s.w = cpBodyGetAngularVelocity(b->b);
+    s.friction = cpShapeGetFriction(b->b->shapeList);
+    s.sleeping = cpBodyIsSleeping(b->b);
+    return s;
+}
+
+de_entity core_restore_fragment(
+    SplitterCore *core, const struct FragmentState *s,
+    const cpVect *verts, int verts_num
+) {
+    assert(core);
+    assert(s);
+    assert(verts);
+    assert(verts_num >= 3);
+    de_ecs *r = core->r;
+    de_entity e = de_create(r);
+
+    cpFloat moment = cpMomentForPoly(
+        s->area * DENSITY, verts_num, verts, cpvzero, 0.
+    );
+    // Вершины уже относительно центра масс
+    create_poly(
+        core, e, (cpVect*)verts, verts_num, s->area, cpvzero, moment
+    );
+    struct Component_Fragment *f = de_get(r, e, comp_fragment);
+    f->serial = s->serial;
+    f->asleep = s->asleep;
+    if (s->serial >= core->fragments_serial)
+        core->fragments_serial = s->serial + 1;
+
+    cpBody *body = ((struct Component_Body*)de_get(r, e, comp_body))->b;
+    cpBodySetPosition(body, s->p);
+    cpBodySetAngle(body, s->a);
+    cpBodySetVelocity(body, s->v);
+    cpBodySetAngularVelocity(body, s->w);
+    cpShapeSetFriction(body->shapeList, s->friction);
+
+    if (s->baked)
+        bake_fragment(core, e);
+    else if (s->sleeping)
+        cpBodySleep(body);
+    return e;
+}
+
+de_entity core_restore_particle(
+    SplitterCore *core, const struct Particle *pt,
+    const cpVect *verts, int verts_num
+) {
+    assert(core);
+    assert(pt);
+    assert(verts);
+    de_entity e = de_create(core->r);
+    struct Component_Mesh *mesh = de_emplace(core->r, e, comp_mesh);
+    mesh_alloc(&core->pool, mesh, verts_num);
+    memcpy(mesh->verts, verts, sizeof(verts[0]) * verts_num);
+
+    struct Particle *slot = particle_slot(core);
+    *slot = *pt;
+    slot->e = e;
+    return e;
+}
+
+void core_init(SplitterCore *core) {
+    assert(core);
+    trace("core_init:\n");
+    core->r = de_ecs_make();
+    memset(&core->stats, 0, sizeof(core->stats));
+    core->clock = (struct SimClock) {
+        .step = 1. / 60.,
+        .max_substeps = 4,
+    };
+    core->fragments = NULL;
+    core->fragments_num = core->fragments_cap = 0;
+    core->fragments_serial = 0;
+    core->particles = NULL;
+    core->particles_num = core->particles_cap = 0;
+    core->baked_version = 0;
+    core->bake = (struct BakeOpts) {
+        .enabled = false,
+        .sleep_time = 2.,
+        .wake_speed = 30.,
+    };
+    core->lod = (struct ParticleLod) {
+        .min_area = 0.,
+        .max_particles = 2048,
+        .lifetime = 3.,
+    };
+    core->broadphase = (struct BroadphaseOpts) {
+        .type = BROADPHASE_BBTREE,
+    };
+    memset(&core->broadphase_state, 0, sizeof(core->broadphase_state));
+    core->broadphase_state.type = BROADPHASE_BBTREE;
+    arena_init(&core->frame_arena, 64 * 1024);
+    pool_init(&core->pool, 4096);
+    workers_init(&core->workers, 0);
+    core->worker_arenas = NULL;
+    create_cp(core);
+}
+
+void core_shutdown(SplitterCore *core) {
+    assert(core);
+    trace("core_shutdown:\n");
+    if (core->space) {
+        space_shutdown((struct SpaceShutdownCtx) {
+            .space = core->space,
+            .free_bodies = true,
+            .free_shapes = true,
+            .free_constraints = true,
+        });
+        cpHastySpaceFree(core->space);
+        core->space = NULL;
+    }
+    if (core->r) {
+        de_ecs_destroy(core->r);
+        core->r = NULL;
+    }
+    free(core->fragments);
+    core->fragments = NULL;
+    core->fragments_num = core->fragments_cap = 0;
+    free(core->particles);
+    core->particles = NULL;
+    core->particles_num = core->particles_cap = 0;
+    core_set_slice_threads(core, 0);
+    workers_shutdown(&core->workers);
+    arena_shutdown(&core->frame_arena);
+    pool_shutdown(&core->pool);
+}
+
+void core_set_slice_threads(SplitterCore *core, int threads_num) {
+    assert(core);
+    assert(threads_num >= 0);
+    for (int i = 0; i < core->workers.threads_num; i++)
+        arena_shutdown(&core->worker_arenas[i]);
+    free(core->worker_arenas);
+    core->worker_arenas = NULL;
+    workers_shutdown(&core->workers);
+
+    workers_init(&core->workers, threads_num);
+    if (core->workers.threads_num) {
+        core->worker_arenas = calloc(
+            core->workers.threads_num, sizeof(core->worker_arenas[0])
+        );
+        assert(core->worker_arenas);
+        for (int i = 0; i < core->workers.threads_num; i++)
+            arena_init(&core->worker_arenas[i], 64 * 1024);
+    }
+    trace("core_set_slice_threads: %d\n", core->workers.threads_num);
+}
+
+void core_set_step_threads(SplitterCore *core, int threads_num) {
+    assert(core);
+    assert(core->space);
+    assert(threads_num >= 0);
+    cpHastySpaceSetThreads(core->space, threads_num);
+    trace(
+        "core_set_step_threads: requested %d, got %d\n",
+        threads_num, core_step_threads(core)
+    );
+}
+
+int core_step_threads(SplitterCore *core) {
+    assert(core);
+    assert(core->space);
+    return (int)cpHastySpaceGetThreads(core->space);
+}
+
+struct EvictKey {
+    cpFloat     key;
+    de_entity   e;
+};
+
+static int cmp_evict_key(const void *a, const void *b) {
+    const struct EvictKey *x = a, *y = b;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+// Вне шага пространства, поэтому куски удаляются сразу
+static void enforce_budget(SplitterCore *core) {
+    int max = core->budget.max_fragments;
+    if (max <= 0 || core->fragments_num <= max)
+        return;
+
+    int num = core->fragments_num;
+    struct EvictKey *keys = arena_alloc(&core->frame_arena, sizeof(keys[0]) * num);
+    for (int i = 0; i < num; i++) {
+        de_entity e = core->fragments[i];
+        struct Component_Fragment *f = de_get(core->r, e, comp_fragment);
+        keys[i].e = e;
+        keys[i].key = core->budget.policy == EVICT_OLDEST ?
+            (cpFloat)f->serial : f->area;
+    }
+    qsort(keys, num, sizeof(keys[0]), cmp_evict_key);
+
+    int evict_num = num - max;
+    trace(
+        "enforce_budget: evict %d of %d, policy %s\n",
+        evict_num, num, evict_policy2str(core->budget.policy)
+    );
+    for (int i = 0; i < evict_num; i++) {
+        struct Component_Body *b = de_try_get(core->r, keys[i].e, comp_body);
+        if (b)
+            destroy_fragment(core, keys[i].e, b->b);
+        else
+            destroy_baked(core, keys[i].e);
+        core->stats.fragments_evicted++;
+    }
+}
+
+static cpVect shape_velocity(cpShape *shape) {
+    return shape->body->v;
+}
+
+static void copy_shape(cpShape *shape, cpSpatialIndex *index) {
+    cpSpatialIndexInsert(index, shape, shape->hashid);
+}
+
+// Обратное к cpSpaceUseSpatialHash(), в chipmunk такого нет
+static void space_use_bbtree(cpSpace *space) {
+    assert(!space->locked);
+    cpSpatialIndex *static_shapes = cpBBTreeNew(
+        (cpSpatialIndexBBFunc)cpShapeGetBB, NULL
+    );
+    cpSpatialIndex *dynamic_shapes = cpBBTreeNew(
+        (cpSpatialIndexBBFunc)cpShapeGetBB, static_shapes
+    );
+    cpBBTreeSetVelocityFunc(
+        dynamic_shapes, (cpBBTreeVelocityFunc)shape_velocity
+    );
+    cpSpatialIndexEach(
+        space->staticShapes, (cpSpatialIndexIteratorFunc)copy_shape,
+        static_shapes
+    );
+    cpSpatialIndexEach(
+        space->dynamicShapes, (cpSpatialIndexIteratorFunc)copy_shape,
+        dynamic_shapes
+    );
+    cpSpatialIndexFree(space->staticShapes);
+    space->staticShapes = static_shapes;
+    cpSpatialIndexFree(space->dynamicShapes);
+    space->dynamicShapes = dynamic_shapes;
+}
+
+static int cmp_cpfloat(const void *a, const void *b) {
+    cpFloat x = *(const cpFloat*)a, y = *(const cpFloat*)b;
+    return (x > y) - (x < y);
+}
+
+// Ячейка по медианному размеру формы куска, ячеек в 10 раз больше, чем
+// форм, как советует документация chipmunk.
+static void broadphase_tune(SplitterCore *core, cpFloat *dim, int *count) {
+    int num = 0;
+    cpFloat *sizes = arena_alloc(
+        &core->frame_arena, sizeof(sizes[0]) * (core->fragments_num + 1)
+    );
+    for (int i = 0; i < core->fragments_num; i++) {
+        de_entity e = core->fragments[i];
+        struct Component_Body *b = de_try_get(core->r, e, comp_body);
+        struct Component_Baked *baked = de_try_get(core->r, e, comp_baked);
+        cpShape *shape = b ? b->b->shapeList : baked ? baked->shape : NULL;
+        if (!shape)
+            continue;
+        cpBB bb = cpShapeGetBB(shape);
+        sizes[num++] = fmax(bb.r - bb.l, bb.t - bb.b);
+    }
+    if (!num) {
+        *dim = 100.;
+        *count = 1000;
+        return;
+    }
+    qsort(sizes, num, sizeof(sizes[0]), cmp_cpfloat);
+    *dim = sizes[num / 2];
+    *count = num * 10 > 1000 ? num * 10 : 1000;
+}
+
+// Вне шага пространства. Хэш перестраивается за O(n), поэтому только при
+// заметном изменении размеров.
+static void broadphase_update(SplitterCore *core) {
+    struct BroadphaseOpts *opts = &core->broadphase;
+    struct BroadphaseState *state = &core->broadphase_state;
+
+    if (opts->type == BROADPHASE_BBTREE) {
+        if (state->type != BROADPHASE_BBTREE) {
+            space_use_bbtree(core->space);
+            state->type = BROADPHASE_BBTREE;
+            state->dim = 0.;
+            state->count = 0;
+            LOG_INFO("broadphase_update: bbtree\n");
+        }
+        return;
+    }
+
+    bool switched = state->type != BROADPHASE_HASH;
+    if (!switched && ++state->steps < BROADPHASE_TUNE_STEPS)
+        return;
+    state->steps = 0;
+
+    cpFloat dim = opts->dim;
+    int count = opts->count;
+    if (dim <= 0. || count <= 0) {
+        cpFloat tuned_dim;
+        int tuned_count;
+        broadphase_tune(core, &tuned_dim, &tuned_count);
+        if (dim <= 0.)
+            dim = tuned_dim;
+        if (count <= 0)
+            count = tuned_count;
+    }
+
+    if (!switched &&
+        fabs(dim - state->dim) < state->dim * 0.25 &&
+        count <= state->count * 2 && count * 4 >= state->count)
+        return;
+
+    cpSpaceUseSpatialHash(core->space, dim, count);
+    state->type = BROADPHASE_HASH;
+    state->dim = dim;
+    state->count = count;
+    state->rebuilds++;
+    LOG_INFO("broadphase_update: hash dim %f, count %d\n", dim, count);
+}
+
+void core_step(SplitterCore *core, double dt) {
+    assert(core);
+    if (core->space) {
+        PROF_BEGIN(PROF_STEP);
+        cpHastySpaceStep(core->space, dt);
+        PROF_END(PROF_STEP);
+        particles_update(core, dt);
+        bake_sleeping(core, dt);
+        enforce_budget(core);
+        broadphase_update(core);
+    }
+    // Все post-step вызовы этого шага отработали
+    arena_reset(&core->frame_arena);
+    for (int i = 0; i < core->workers.threads_num; i++)
+        arena_reset(&core->worker_arenas[i]);
+}
+
+static void bodies_snapshot(SplitterCore *core) {
+    de_view_single view = de_create_view_single(core->r, comp_body);
+    while (de_view_single_valid(&view)) {
+        struct Component_Body *b = de_view_single_get(&view);
+        b->prev_p = b->b->p;
+        b->prev_a = b->b->a;
+        b->has_prev = true;
+        de_view_single_next(&view);
+    }
+}
+
+int core_advance(SplitterCore *core, double frame_dt) {
+    assert(core);
+    struct SimClock *c = &core->clock;
+    assert(c->step > 0.);
+    assert(c->max_substeps > 0);
+    c->accum += frame_dt;
+
+    int steps = 0;
+    while (c->accum >= c->step && steps < c->max_substeps) {
+        bodies_snapshot(core);
+        core_step(core, c->step);
+        c->accum -= c->step;
+        steps++;
+    }
+    // Не успеваем: симуляция замедляется, но кадр не растет от шага к шагу
+    if (c->accum >= c->step) {
+        c->accum = fmod(c->accum, c->step);
+        c->frames_capped++;
+    }
+    c->steps += steps;
+    c->alpha = c->accum / c->step;
+    return steps;
+}
+
+cpTransform core_body_transform(const struct Component_Body *b, double alpha) {
+    assert(b);
+    const cpBody *body = b->b;
+    if (!b->has_prev)
+        return body->transform;
+    cpVect p = cpvlerp(b->prev_p, body->p, alpha);
+    cpFloat a = b->prev_a + (body->a - b->prev_a) * alpha;
+    return cpTransformMult(
+        cpTransformRigid(p, a), cpTransformTranslate(cpvneg(body->cog))
+    );
+}
+
+int core_body_count(SplitterCore *core) {
+    assert(core);
+    int num = 0;
+    de_view_single view = de_create_view_single(core->r, comp_body);
+    while (de_view_single_valid(&view)) {
+        num++;
+        de_view_single_next(&view);
+    }
+    return num;
+}
+
+int core_particle_count(SplitterCore *core) {
+    assert(core);
+    return core->particles_num;
+}
+
+int core_baked_count(SplitterCore *core) {
+    assert(core);
+    int num = 0;
+    de_view_single view = de_create_view_single(core->r, comp_baked);
+    while (de_view_single_valid(&view)) {
+        num++;
+        de_view_single_next(&view);
+    }
+    return num;
+}
+
+int core_fragment_count(SplitterCore *core) {
+    assert(core);
+    return core->fragments_num;
+}
+
+const char *broadphase2str(enum BroadphaseType type) {
+    switch (type) {
+        case BROADPHASE_BBTREE: return "bbtree";
+        case BROADPHASE_HASH: return "hash";
+    }
+    return "unknown";
+}
+
+const char *evict_policy2str(enum EvictPolicy policy) {
+    switch (policy) {
+        case EVICT_SMALLEST: return "smallest";
+        case EVICT_OLDEST: return "oldest";
+    }
+    return "unknown";
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+// Физика и ECS разрезателя без зависимости от окна и GL контекста.
+// Используется стадией splitter и headless бенчмарком splitter_bench.
+
+#include "chipmunk/chipmunk.h"
+#include "koh_destral_ecs.h"
+#include "splitter_arena.h"
+#include "splitter_planes.h"
+#include "splitter_pool.h"
+#include "splitter_workers.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DENSITY (1.0/10000.0)
+
+#define GRABBABLE_MASK_BIT (1<<31)
+
+typedef struct SplitterCore SplitterCore;
+
+struct Component_Body {
+    cpBody  *b;
+    // Положение до последнего шага для интерполяции, см. core_body_transform()
+    cpVect  prev_p;
+    cpFloat prev_a;
+    bool    has_prev;
+};
+
+// Положение куска внутри исходного глифа и его аналитическая маска.
+struct Component_Mask {
+    // Из системы координат глифа (центр текстуры) в локальную систему тела
+    cpTransform         tr;
+    cpVect              size;
+    struct ClipPlanes   planes;
+};
+
+// Триангуляция формы куска в локальной системе тела. Строится один раз при
+// создании формы, используется отрисовкой, масками и отладкой.
+struct Component_Mesh {
+    cpVect  *verts;
+    int     *indices;
+    // verts_cap - размер блока из пула, см. pool_mesh_alloc()
+    int     verts_num, tris_num, verts_cap;
+};
+
+// Запись куска в реестре ядра
+struct Component_Fragment {
+    cpFloat     area;
+    // Порядковый номер создания, меньше - старше
+    uint64_t    serial;
+    // Индекс в SplitterCore.fragments
+    int         slot;
+    // Сколько секунд тело спит подряд
+    float       asleep;
+};
+
+// Уснувший кусок, перенесенный в статический слой. Тела нет, форма
+// в мировых координатах висит на SplitterCore.static_layer.
+struct Component_Baked {
+    cpShape     *shape;
+    // Положение тела в момент запекания
+    cpTransform body2world;
+};
+
+extern de_cp_type comp_body;
+extern de_cp_type comp_mask;
+extern de_cp_type comp_mesh;
+extern de_cp_type comp_fragment;
+extern de_cp_type comp_baked;
+
+// Тип столкновения форм статического слоя
+#define COLLISION_BAKED 1
+
+struct BakeOpts {
+    bool    enabled;
+    // Сколько секунд кусок должен проспать перед запеканием
+    float   sleep_time;
+    // Касание телом быстрее этого возвращает кусок обратно в динамику
+    cpFloat wake_speed;
+};
+
+enum EvictPolicy {
+    EVICT_SMALLEST,
+    EVICT_OLDEST,
+};
+
+// Ограничение числа кусков. При превышении после шага удаляются
+// самые маленькие или самые старые.
+struct FragmentBudget {
+    // 0 - без ограничения
+    int                 max_fragments;
+    enum EvictPolicy    policy;
+};
+
+enum BroadphaseType {
+    BROADPHASE_BBTREE,
+    BROADPHASE_HASH,
+};
+
+// Широкая фаза пространства. Применяется в core_step() вне шага.
+struct BroadphaseOpts {
+    enum BroadphaseType type;
+    // Размер ячейки и число ячеек хэша, 0 - подбирать по размерам живых
+    // кусков каждые BROADPHASE_TUNE_STEPS шагов
+    cpFloat             dim;
+    int                 count;
+};
+
+#define BROADPHASE_TUNE_STEPS   30
+
+// Что сейчас стоит в пространстве
+struct BroadphaseState {
+    enum BroadphaseType type;
+    cpFloat             dim;
+    int                 count;
+    int                 steps;
+    // Сколько раз хэш перестраивался
+    uint64_t            rebuilds;
+};
+
+// Мелкий кусок без тела и формы: не сталкивается, движется сам по себе и
+// исчезает через lifetime секунд. Сущность сохраняет comp_mesh и comp_mask.
+struct Particle {
+    de_entity   e;
+    cpVect      p, v;
+    cpFloat     a, w;
+    float       life;
+};
+
+// Куски с площадью меньше min_area становятся частицами.
+struct ParticleLod {
+    // 0 - выключено
+    cpFloat     min_area;
+    // При заполнении заменяется частица с наименьшим оставшимся временем
+    int         max_particles;
+    float       lifetime;
+};
+
+// Часы симуляции с постоянным шагом, не зависят от частоты кадров.
+struct SimClock {
+    double      step;
+    // Больше шагов за кадр не делается, лишнее время отбрасывается
+    int         max_substeps;
+    double      accum;
+    // Доля шага между предыдущим и текущим состоянием для отрисовки
+    double      alpha;
+    uint64_t    steps, frames_capped;
+};
+
+// Все, что нужно для воссоздания куска без истории разрезов, см.
+// splitter_snapshot.h
+struct FragmentState {
+    cpVect      p, v;
+    cpFloat     a, w;
+    cpFloat     area, friction;
+    uint64_t    serial;
+    float       asleep;
+    bool        sleeping, baked;
+};
+
+struct SplitterCoreHooks {
+    // Вызывается при каждом разрезе, до запроса к пространству.
+    void (*on_slice)(SplitterCore *core, cpVect from, cpVect to);
+    // Вызывается из post-step для каждого нового куска или частицы.
+    // old_body еще жив.
+    void (*on_fragment)(
+        SplitterCore *core, de_entity e_new, de_entity e_old, cpBody *old_body
+    );
+    // Время выполнения одного post-step разреза в секундах.
+    void (*on_poststep)(SplitterCore *core, double seconds);
+};
+
+struct SplitterCoreStats {
+    uint64_t slices, shapes_cut, fragments_created, fragments_destroyed;
+    uint64_t fragments_evicted;
+    uint64_t particles_spawned, particles_expired;
+    uint64_t fragments_baked, fragments_unbaked;
+};
+
+struct SplitterCore {
+    cpSpace                     *space;
+    de_ecs                      *r;
+    struct SplitterCoreHooks    hooks;
+    void                        *udata;
+    struct SplitterCoreStats    stats;
+    struct SimClock             clock;
+    // Контексты разрезов и рабочие данные post-step, сбрасывается в core_step
+    struct Arena                frame_arena;
+    // Память тел, форм и триангуляций кусков
+    struct FragmentPool         pool;
+    // Все живые куски, включая исходные глифы
+    de_entity                   *fragments;
+    int                         fragments_num, fragments_cap;
+    uint64_t                    fragments_serial;
+    struct FragmentBudget       budget;
+    struct BroadphaseOpts       broadphase;
+    struct BroadphaseState      broadphase_state;
+    struct Particle             *particles;
+    int                         particles_num, particles_cap;
+    struct ParticleLod          lod;
+    // Статическое тело пространства, на нем формы запеченных кусков
+    cpBody                      *static_layer;
+    // Меняется при каждом запекании или возврате, для кэша отрисовки
+    uint64_t                    baked_version;
+    struct BakeOpts             bake;
+    // Геометрия разрезов считается на этих потоках, см. core_set_slice_threads()
+    struct WorkerPool           workers;
+    // По арене на поток пула, главный поток пользуется frame_arena
+    struct Arena                *worker_arenas;
+};
+
+void core_init(SplitterCore *core);
+void core_shutdown(SplitterCore *core);
+void core_step(SplitterCore *core, double dt);
+// Копит время кадра и делает столько шагов clock.step, сколько набралось.
+// Возвращает число шагов.
+int core_advance(SplitterCore *core, double frame_dt);
+// Положение тела между двумя последними шагами, alpha из SimClock
+cpTransform core_body_transform(const struct Component_Body *b, double alpha);
+// 0 - разрезы целиком в главном потоке
+void core_set_slice_threads(SplitterCore *core, int threads_num);
+// Потоки решателя cpHastySpace: 1 - без потоков, 0 - по числу ядер.
+// Chipmunk ограничивает число сверху, см. core_step_threads().
+void core_set_step_threads(SplitterCore *core, int threads_num);
+int core_step_threads(SplitterCore *core);
+
+void core_create_floor_and_walls(SplitterCore *core);
+de_entity core_create_box(SplitterCore *core, cpVect center, cpVect wh);
+void core_slice(SplitterCore *core, cpVect from, cpVect to);
+// Разрез ломаной за один post-step. Форма режется по хордам, где ломаная
+// проходит ее насквозь.
+void core_slice_polyline(SplitterCore *core, const cpVect *pts, int pts_num);
+void core_diagonal_slice(SplitterCore *core, de_entity e);
+
+// Состояние живого куска или запеченного, см. core_restore_fragment()
+struct FragmentState core_fragment_state(SplitterCore *core, de_entity e);
+// Новый кусок из состояния. verts - форма в локальной системе тела с
+// началом в центре масс. Маску ставит вызывающий.
+de_entity core_restore_fragment(
+    SplitterCore *core, const struct FragmentState *s,
+    const cpVect *verts, int verts_num
+);
+// Частица с pt->e, замененным на новую сущность
+de_entity core_restore_particle(
+    SplitterCore *core, const struct Particle *pt,
+    const cpVect *verts, int verts_num
+);
+
+int core_body_count(SplitterCore *core);
+int core_fragment_count(SplitterCore *core);
+int core_particle_count(SplitterCore *core);
+int core_baked_count(SplitterCore *core);
+// Из локальной системы частицы в мировую
+static inline cpTransform particle_transform(const struct Particle *pt) {
+    return cpTransformRigid(pt->p, pt->a);
+}
+// То же на back секунд назад, движение частицы за шаг линейное
+static inline cpTransform particle_transform_back(
+    const struct Particle *pt, cpFloat back
+) {
+    return cpTransformRigid(
+        cpvsub(pt->p, cpvmult(pt->v, back)), pt->a - pt->w * back
+    );
+}
+const char *evict_policy2str(enum EvictPolicy policy);
+const char *broadphase2str(enum BroadphaseType type);
+// Монотонное время в секундах, не требует окна.
+double core_time(void);
@@ -0,0 +1,173 @@
+#include "splitter_dump.h"
+
+#include "koh_logger.h"
+#include "raylib.h"
+#include "splitter_raster.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct DumpItem {
+    Image   img;
+    // Не NULL - маска еще не растеризована, см. dump_push_mask()
+    cpVect  *verts;
+    int     verts_num;
+    char    fname[128];
+};
+
+static struct {
+    struct DumpItem *items;
+    int             cap, head, num;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    bool            running;
+    uint64_t        written, dropped;
+} dump = {0};
+
+static atomic_bool is_enabled = false;
+
+static void *dump_thread(void *arg) {
+    pthread_mutex_lock(&dump.lock);
+    for (;;) {
+        while (!dump.num && dump.running)
+            pthread_cond_wait(&dump.cond, &dump.lock);
+
+        // При остановке сначала дописывается все, что уже в очереди
+        if (!dump.num && !dump.running)
+            break;
+
+        struct DumpItem item = dump.items[dump.head];
+        dump.head = (dump.head + 1) % dump.cap;
+        dump.num--;
+
+        pthread_mutex_unlock(&dump.lock);
+        if (item.verts) {
+            raster_convex(
+                item.verts, item.verts_num,
+                item.img.width, item.img.height, item.img.data
+            );
+            free(item.verts);
+        }
+        ExportImage(item.img, item.fname);
+        UnloadImage(item.img);
+        pthread_mutex_lock(&dump.lock);
+
+        dump.written++;
+    }
+    pthread_mutex_unlock(&dump.lock);
+    return NULL;
+}
+
+void dump_init(int queue_cap) {
+    assert(queue_cap > 0);
+    assert(!dump.items);
+    dump.cap = queue_cap;
+    dump.items = calloc(dump.cap, sizeof(dump.items[0]));
+    assert(dump.items);
+    dump.head = dump.num = 0;
+    dump.written = dump.dropped = 0;
+    dump.running = true;
+    pthread_mutex_init(&dump.lock, NULL);
+    pthread_cond_init(&dump.cond, NULL);
+    if (pthread_create(&dump.thread, NULL, dump_thread, NULL)) {
+        trace("dump_init: could not create writer thread\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void dump_shutdown(void) {
+    if (!dump.items)
+        return;
+
+    atomic_store(&is_enabled, false);
+    pthread_mutex_lock(&dump.lock);
+    dump.running = false;
+    pthread_cond_signal(&dump.cond);
+    pthread_mutex_unlock(&dump.lock);
+    pthread_join(dump.thread, NULL);
+
+    trace(
+        "dump_shutdown: written %lu, dropped %lu\n",
+        (unsigned long)dump.written, (unsigned long)dump.dropped
+    );
+
+    pthread_cond_destroy(&dump.cond);
+    pthread_mutex_destroy(&dump.lock);
+    free(dump.items);
+    memset(&dump, 0, sizeof(dump));
+}
+
+void dump_enable(bool enabled) {
+    atomic_store(&is_enabled, enabled);
+}
+
+bool dump_is_enabled(void) {
+    return atomic_load_explicit(&is_enabled, memory_order_relaxed);
+}
+
+static bool push(Image img, cpVect *verts, int verts_num, const char *fname) {
+    assert(fname);
+    assert(dump.items);
+
+    pthread_mutex_lock(&dump.lock);
+    if (dump.num == dump.cap) {
+        dump.dropped++;
+        pthread_mutex_unlock(&dump.lock);
+        UnloadImage(img);
+        free(verts);
+        return false;
+    }
+
+    struct DumpItem *item = &dump.items[(dump.head + dump.num) % dump.cap];
+    item->img = img;
+    item->verts = verts;
+    item->verts_num = verts_num;
+    strncpy(item->fname, fname, sizeof(item->fname) - 1);
+    item->fname[sizeof(item->fname) - 1] = 0;
+    dump.num++;
+    pthread_cond_signal(&dump.cond);
+    pthread_mutex_unlock(&dump.lock);
+    return true;
+}
+
+bool dump_push(Image img, const char *fname) {
+    return push(img, NULL, 0, fname);
+}
+
+bool dump_push_mask(
+    const cpVect *verts, int num, int w, int h, const char *fname
+) {
+    assert(verts);
+    assert(num > 0);
+    assert(w > 0 && h > 0);
+
+    cpVect *copy = malloc(sizeof(copy[0]) * num);
+    uint8_t *data = malloc((size_t)w * h);
+    assert(copy && data);
+    memcpy(copy, verts, sizeof(copy[0]) * num);
+    Image img = {
+        .data = data,
+        .width = w,
+        .height = h,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
+    };
+    return push(img, copy, num, fname);
+}
+
+struct DumpStats dump_stats(void) {
+    struct DumpStats stats = {0};
+    if (!dump.items)
+        return stats;
+    pthread_mutex_lock(&dump.lock);
+    stats.written = dump.written;
+    stats.dropped = dump.dropped;
+    stats.queued = dump.num;
+    pthread_mutex_unlock(&dump.lock);
+    return stats;
+}
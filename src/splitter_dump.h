@@ -0,0 +1,31 @@
+#pragma once
+
+// Отладочное сохранение изображений на диск в фоновом потоке.
+// Пока режим выключен dump_push() не вызывается и дискового ввода-вывода нет.
+
+#include "chipmunk/chipmunk.h"
+#include "raylib.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct DumpStats {
+    uint64_t    written, dropped;
+    int         queued;
+};
+
+void dump_init(int queue_cap);
+void dump_shutdown(void);
+
+void dump_enable(bool enabled);
+bool dump_is_enabled(void);
+
+// Забирает владение img. Если очередь заполнена, то изображение выгружается
+// и возвращается false.
+bool dump_push(Image img, const char *fname);
+// Маска w * h из выпуклого многоугольника в пикселях маски. Растеризуется
+// в потоке записи, вызывающий поток только копирует вершины.
+bool dump_push_mask(
+    const cpVect *verts, int num, int w, int h, const char *fname
+);
+
+struct DumpStats dump_stats(void);
@@ -0,0 +1,327 @@
+#include "splitter_glyphs.h"
+
+#include "koh_logger.h"
+#include "raylib.h"
+#include "splitter_log.h"
+#include "splitter_sdf.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Зазор между строками на странице, чтобы фильтрация не тянула соседей
+#define GLYPH_PADDING   2
+
+static uint32_t key_hash(const char *text, int size) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (const char *p = text; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    h ^= (uint32_t)size;
+    h *= 16777619u;
+    return h;
+}
+
+static struct GlyphEntry *cache_find(
+    struct GlyphCache *c, const char *text, int size, uint32_t hash
+) {
+    for (int i = 0; i < c->entries_num; i++) {
+        struct GlyphEntry *en = c->entries[i];
+        if (en->hash == hash && en->size == size && !strcmp(en->key, text))
+            return en;
+    }
+    return NULL;
+}
+
+// false - страниц уже GLYPH_PAGES_MAX
+static bool page_new(struct GlyphCache *c, int w, int h) {
+    if (c->pages_num == GLYPH_PAGES_MAX) {
+        if (!c->stats.overflow)
+            LOG_WARN(
+                "page_new: %d pages used, new strings get own textures\n",
+                GLYPH_PAGES_MAX
+            );
+        return false;
+    }
+    int i = c->pages_num++;
+    if (c->sdf) {
+        // Нули - далеко снаружи, соседние поля не просвечивают
+        Image img = {
+            .data = calloc(w * h, 1),
+            .width = w,
+            .height = h,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
+        };
+        assert(img.data);
+        c->pages[i] = LoadTextureFromImage(img);
+        UnloadImage(img);
+        SetTextureFilter(c->pages[i], TEXTURE_FILTER_BILINEAR);
+        c->stats.bytes += (size_t)w * h;
+    } else {
+        c->targets[i] = LoadRenderTexture(w, h);
+        BeginTextureMode(c->targets[i]);
+        ClearBackground(BLANK);
+        EndTextureMode();
+        c->pages[i] = c->targets[i].texture;
+        c->stats.bytes += (size_t)w * h * 4;
+    }
+    c->shelf_x = c->shelf_y = c->shelf_h = 0;
+    c->stats.pages++;
+    LOG_INFO("page_new: %dx%d, pages %d\n", w, h, c->pages_num);
+    return true;
+}
+
+// Место под w x h на последней странице, при нехватке - новая страница.
+// Строка больше страницы получает страницу своего размера. -1 - страницы
+// кончились.
+static int page_alloc(struct GlyphCache *c, int w, int h, int *x, int *y) {
+    if (w > c->page_size || h > c->page_size) {
+        if (!page_new(c, w, h))
+            return -1;
+        // Страница занята целиком
+        c->shelf_y = h;
+        *x = *y = 0;
+        return c->pages_num - 1;
+    }
+
+    if (!c->pages_num && !page_new(c, c->page_size, c->page_size))
+        return -1;
+
+    Texture2D *page = &c->pages[c->pages_num - 1];
+    if (c->shelf_x + w > page->width) {
+        c->shelf_x = 0;
+        c->shelf_y += c->shelf_h + GLYPH_PADDING;
+        c->shelf_h = 0;
+    }
+    if (c->shelf_y + h > page->height &&
+        !page_new(c, c->page_size, c->page_size))
+        return -1;
+
+    *x = c->shelf_x;
+    *y = c->shelf_y;
+    c->shelf_x += w + GLYPH_PADDING;
+    if (h > c->shelf_h)
+        c->shelf_h = h;
+    return c->pages_num - 1;
+}
+
+static void draw_string(
+    struct GlyphCache *c, const char *text, int size, int x, int y, int w,
+    int h
+) {
+    const float thick = 4.;
+    DrawTextEx(c->fnt, text, (Vector2) { x, y }, size, 0., WHITE);
+    DrawRectangleLinesEx(
+        (Rectangle) { .x = x, .y = y, .width = w, .height = h, },
+        thick, BLUE
+    );
+}
+
+// Без места на страницах строка получает свою текстуру, см. GlyphEntry.own
+static void bake_pixels(
+    struct GlyphCache *c, const char *text, int size, int w, int h,
+    struct GlyphEntry *en
+) {
+    struct GlyphTexture *g = &en->glyph;
+    int x = 0, y = 0;
+    int page = page_alloc(c, w, h, &x, &y);
+    RenderTexture2D target;
+    if (page >= 0) {
+        target = c->targets[page];
+    } else {
+        target = LoadRenderTexture(w, h);
+        en->own = true;
+        en->own_target = target;
+        c->stats.overflow++;
+        c->stats.bytes += (size_t)w * h * 4;
+        BeginTextureMode(target);
+        ClearBackground(BLANK);
+        EndTextureMode();
+    }
+    BeginTextureMode(target);
+    draw_string(c, text, size, x, y, w, h);
+    EndTextureMode();
+
+    float pw = target.texture.width, ph = target.texture.height;
+    g->tex = target.texture;
+    // Нижний ряд текстуры соответствует верхнему ряду рисования
+    g->src = (Rectangle) { x, ph - y - h, w, -h };
+    g->uv = (Rectangle) { x / pw, (ph - y) / ph, w / pw, -h / ph };
+}
+
+// Строка рисуется во временную render texture во весь размер, читается
+// обратно и сжимается в поле расстояний. Только при промахе кэша.
+static void bake_sdf(
+    struct GlyphCache *c, const char *text, int size, int w, int h,
+    struct GlyphEntry *en
+) {
+    struct GlyphTexture *g = &en->glyph;
+    RenderTexture2D scratch = LoadRenderTexture(w, h);
+    BeginTextureMode(scratch);
+    ClearBackground(BLANK);
+    draw_string(c, text, size, 0, 0, w, h);
+    EndTextureMode();
+    Image img = LoadImageFromTexture(scratch.texture);
+    UnloadRenderTexture(scratch);
+    ImageFlipVertical(&img);
+    ImageFormat(&img, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    assert(img.width == w && img.height == h);
+
+    uint8_t *alpha = malloc(w * h);
+    assert(alpha);
+    const uint8_t *rgba = img.data;
+    for (int i = 0; i < w * h; i++)
+        alpha[i] = rgba[i * 4 + 3];
+    UnloadImage(img);
+
+    int sw = sdf_size(w, GLYPH_SDF_SCALE), sh = sdf_size(h, GLYPH_SDF_SCALE);
+    uint8_t *field = malloc(sw * sh);
+    assert(field);
+    sdf_generate(alpha, w, h, GLYPH_SDF_SCALE, GLYPH_SDF_SPREAD, field);
+    free(alpha);
+
+    int x = 0, y = 0;
+    int page = page_alloc(c, sw, sh, &x, &y);
+    Texture2D tex;
+    if (page >= 0) {
+        tex = c->pages[page];
+        UpdateTextureRec(tex, (Rectangle) { x, y, sw, sh }, field);
+    } else {
+        Image img = {
+            .data = field,
+            .width = sw,
+            .height = sh,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
+        };
+        tex = LoadTextureFromImage(img);
+        SetTextureFilter(tex, TEXTURE_FILTER_BILINEAR);
+        en->own = true;
+        c->stats.overflow++;
+        c->stats.bytes += (size_t)sw * sh;
+    }
+    free(field);
+
+    float pw = tex.width, ph = tex.height;
+    g->tex = tex;
+    g->src = (Rectangle) { x, y, sw, sh };
+    g->uv = (Rectangle) { x / pw, y / ph, sw / pw, sh / ph };
+}
+
+static struct GlyphEntry *cache_bake(
+    struct GlyphCache *c, const char *text, int size, uint32_t hash
+) {
+    Vector2 measure = MeasureTextEx(c->fnt, text, size, 0.);
+    int w = measure.x, h = measure.y;
+    assert(w > 0 && h > 0);
+
+    struct GlyphEntry *en = calloc(1, sizeof(*en));
+    assert(en);
+    strncpy(en->key, text, GLYPH_KEY_MAX - 1);
+    en->size = size;
+    en->hash = hash;
+    en->glyph.size = (Vector2) { w, h };
+    if (c->sdf)
+        bake_sdf(c, text, size, w, h, en);
+    else
+        bake_pixels(c, text, size, w, h, en);
+
+    if (c->entries_num == c->entries_cap) {
+        c->entries_cap = c->entries_cap ? c->entries_cap * 2 : 64;
+        c->entries = realloc(
+            c->entries, sizeof(c->entries[0]) * c->entries_cap
+        );
+        assert(c->entries);
+    }
+    c->entries[c->entries_num++] = en;
+    c->stats.strings++;
+    LOG_DEBUG(
+        "cache_bake: '%s' size %d, %dx%d, page %d%s\n",
+        text, size, w, h, en->own ? -1 : c->pages_num - 1,
+        c->sdf ? " sdf" : ""
+    );
+    return en;
+}
+
+void glyph_cache_init(struct GlyphCache *c, Font fnt, int size, bool sdf) {
+    assert(c);
+    memset(c, 0, sizeof(*c));
+    c->fnt = fnt;
+    c->sdf = sdf;
+    c->page_size = sdf ? GLYPH_SDF_PAGE_SIZE : GLYPH_PAGE_SIZE;
+    for (char ch = 'A'; ch <= 'Z'; ch++) {
+        char text[2] = { ch, 0 };
+        glyph_cache_get(c, text, size);
+    }
+    // Запекание при запуске промахом не считается
+    c->stats.misses = 0;
+    trace(
+        "glyph_cache_init: strings %d, pages %d, %zu KB%s\n",
+        c->stats.strings, c->stats.pages, c->stats.bytes / 1024,
+        sdf ? ", sdf" : ""
+    );
+}
+
+void glyph_cache_shutdown(struct GlyphCache *c) {
+    assert(c);
+    trace(
+        "glyph_cache_shutdown: strings %d, hits %llu, misses %llu\n",
+        c->stats.strings, (unsigned long long)c->stats.hits,
+        (unsigned long long)c->stats.misses
+    );
+    for (int i = 0; i < c->entries_num; i++) {
+        struct GlyphEntry *en = c->entries[i];
+        if (en->own && c->sdf)
+            UnloadTexture(en->glyph.tex);
+        else if (en->own)
+            UnloadRenderTexture(en->own_target);
+        free(en);
+    }
+    free(c->entries);
+    for (int i = 0; i < c->pages_num; i++)
+        if (c->sdf)
+            UnloadTexture(c->pages[i]);
+        else
+            UnloadRenderTexture(c->targets[i]);
+    memset(c, 0, sizeof(*c));
+}
+
+struct GlyphTexture *glyph_cache_get(
+    struct GlyphCache *c, const char *text, int size
+) {
+    assert(c);
+    assert(text);
+    assert(strlen(text) < GLYPH_KEY_MAX);
+    uint32_t hash = key_hash(text, size);
+    struct GlyphEntry *en = cache_find(c, text, size, hash);
+    if (en) {
+        c->stats.hits++;
+        return &en->glyph;
+    }
+    c->stats.misses++;
+    return &cache_bake(c, text, size, hash)->glyph;
+}
+
+const char *glyph_key(const struct GlyphTexture *g) {
+    assert(g);
+    // Текстура всегда лежит внутри записи кэша
+    const struct GlyphEntry *en = (const struct GlyphEntry*)(
+        (const char*)g - offsetof(struct GlyphEntry, glyph)
+    );
+    return en->key;
+}
+
+struct GlyphTexture *glyph_ref(struct GlyphTexture *g) {
+    assert(g);
+    g->refs++;
+    return g;
+}
+
+void glyph_unref(struct GlyphTexture *g) {
+    assert(g);
+    assert(g->refs > 0);
+    g->refs--;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// Кэш текстур строк по тексту и размеру шрифта. Строки пакуются полками в
+// общие страницы-атласы, A-Z запекаются при запуске. Повторный запрос строки
+// не трогает GPU, страница создается только когда старые заполнены. Когда
+// занято GLYPH_PAGES_MAX страниц, новая строка получает свою текстуру.
+// Все текстуры живут до glyph_cache_shutdown().
+//
+// В режиме sdf страница хранит не пиксели строки, а поле расстояний,
+// уменьшенное в GLYPH_SDF_SCALE раз. Рисуется шейдером с порогом по 128.
+
+#include "raylib.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GLYPH_PAGE_SIZE     2048
+#define GLYPH_PAGES_MAX     16
+#define GLYPH_KEY_MAX       64
+
+#define GLYPH_SDF_PAGE_SIZE 512
+#define GLYPH_SDF_SCALE     8
+// В выходных текселях, см. sdf_generate()
+#define GLYPH_SDF_SPREAD    4.f
+
+// Строка на странице атласа, общая для всех кусков
+struct GlyphTexture {
+    Texture2D   tex;
+    // Размер строки в пикселях шрифта, от режима не зависит
+    Vector2     size;
+    // Область на странице в пикселях для DrawTexturePro(). Для render
+    // texture высота отрицательная, она перевернута по y.
+    Rectangle   src;
+    // Та же область в нормализованных координатах, см. BatchItem.uv
+    Rectangle   uv;
+    // Сколько сущностей держат строку, на время жизни не влияет
+    int         refs;
+};
+
+struct GlyphEntry {
+    char                key[GLYPH_KEY_MAX];
+    int                 size;
+    uint32_t            hash;
+    struct GlyphTexture glyph;
+    // Страницы кончились, glyph.tex принадлежит записи. В обычном режиме
+    // это текстура own_target.
+    bool                own;
+    RenderTexture2D     own_target;
+};
+
+struct GlyphCacheStats {
+    int         pages, strings;
+    // Строк со своей текстурой вне страниц
+    int         overflow;
+    uint64_t    hits, misses;
+    // Память страниц на GPU
+    size_t      bytes;
+};
+
+struct GlyphCache {
+    Font                    fnt;
+    bool                    sdf;
+    int                     page_size;
+    // Обычный режим рисует строки прямо в targets[], sdf дописывает
+    // текстуры через UpdateTextureRec()
+    RenderTexture2D         targets[GLYPH_PAGES_MAX];
+    Texture2D               pages[GLYPH_PAGES_MAX];
+    int                     pages_num;
+    // Свободное место на последней странице: текущая полка
+    int                     shelf_x, shelf_y, shelf_h;
+    struct GlyphEntry       **entries;
+    int                     entries_num, entries_cap;
+    struct GlyphCacheStats  stats;
+};
+
+// Шрифт остается у вызывающего. Сразу запекает A-Z размером size.
+void glyph_cache_init(struct GlyphCache *c, Font fnt, int size, bool sdf);
+void glyph_cache_shutdown(struct GlyphCache *c);
+
+// Не NULL. Первый запрос строки рисует ее на странице атласа.
+struct GlyphTexture *glyph_cache_get(
+    struct GlyphCache *c, const char *text, int size
+);
+
+// Строка, по которой глиф был получен из glyph_cache_get()
+const char *glyph_key(const struct GlyphTexture *g);
+struct GlyphTexture *glyph_ref(struct GlyphTexture *g);
+void glyph_unref(struct GlyphTexture *g);
@@ -0,0 +1,163 @@
+#include "splitter_log.h"
+
+#include "koh_logger.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Пока кольцо пусто, поток вывода спит столько
+#define LOG_IDLE_NS     2000000
+
+// Ограниченная очередь Вьюкова: seq == pos - ячейка свободна для записи
+// номер pos, seq == pos + 1 - сообщение pos готово к выводу.
+struct LogSlot {
+    atomic_size_t   seq;
+    char            msg[LOG_MSG_MAX];
+};
+
+static struct LogSlot ring[LOG_RING_CAP];
+static atomic_size_t enqueue_pos = 0;
+// Читает только поток вывода
+static size_t dequeue_pos = 0;
+static atomic_bool is_running = false;
+// Вызовы log_push(), которые могли увидеть is_running и еще пишут в кольцо
+static atomic_int in_flight = 0;
+static atomic_bool stop = false;
+static atomic_uint_fast64_t written = 0, dropped = 0;
+static pthread_t thread;
+
+_Static_assert(
+    (LOG_RING_CAP & (LOG_RING_CAP - 1)) == 0, "LOG_RING_CAP: power of two"
+);
+
+// debug и info выводятся как обычный trace()
+static const char *level_prefix(int level) {
+    switch (level) {
+        case LOG_LEVEL_WARN: return "warn: ";
+        case LOG_LEVEL_ERROR: return "error: ";
+        default: return "";
+    }
+}
+
+static void format_msg(char *msg, int level, const char *fmt, va_list args) {
+    const char *prefix = level_prefix(level);
+    size_t len = strlen(prefix);
+    memcpy(msg, prefix, len);
+    vsnprintf(msg + len, LOG_MSG_MAX - len, fmt, args);
+}
+
+static bool drain_one(void) {
+    struct LogSlot *slot = &ring[dequeue_pos & (LOG_RING_CAP - 1)];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != dequeue_pos + 1)
+        return false;
+    trace("%s", slot->msg);
+    atomic_store_explicit(
+        &slot->seq, dequeue_pos + LOG_RING_CAP, memory_order_release
+    );
+    dequeue_pos++;
+    atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+    return true;
+}
+
+static void *log_thread(void *arg) {
+    const struct timespec idle = { .tv_sec = 0, .tv_nsec = LOG_IDLE_NS };
+    while (!atomic_load(&stop)) {
+        if (!drain_one())
+            nanosleep(&idle, NULL);
+    }
+    while (drain_one());
+    return NULL;
+}
+
+void log_init(void) {
+    assert(!atomic_load(&is_running));
+    for (size_t i = 0; i < LOG_RING_CAP; i++)
+        atomic_store_explicit(&ring[i].seq, i, memory_order_relaxed);
+    atomic_store(&enqueue_pos, 0);
+    dequeue_pos = 0;
+    atomic_store(&stop, false);
+    if (pthread_create(&thread, NULL, log_thread, NULL)) {
+        trace("log_init: could not create thread, logging synchronously\n");
+        return;
+    }
+    atomic_store(&is_running, true);
+    trace("log_init: level %d, ring %d\n", SPLITTER_LOG_LEVEL, LOG_RING_CAP);
+}
+
+void log_shutdown(void) {
+    if (!atomic_load(&is_running))
+        return;
+    // Сообщения, начатые после этой точки, уходят в trace() напрямую.
+    // Уже занявшие ячейку должны ее опубликовать до последнего прохода
+    // потока вывода, иначе он остановится на ней и сообщение пропадет
+    // без учета.
+    atomic_store(&is_running, false);
+    const struct timespec wait = { .tv_sec = 0, .tv_nsec = 100000 };
+    while (atomic_load(&in_flight))
+        nanosleep(&wait, NULL);
+    atomic_store(&stop, true);
+    pthread_join(thread, NULL);
+    trace(
+        "log_shutdown: written %lu, dropped %lu\n",
+        (unsigned long)atomic_load(&written),
+        (unsigned long)atomic_load(&dropped)
+    );
+}
+
+bool log_push(int level, const char *fmt, ...) {
+    assert(fmt);
+    va_list args;
+    va_start(args, fmt);
+
+    // Пара с log_shutdown(): seq_cst, чтобы либо поток увидел is_running
+    // сброшенным, либо log_shutdown() увидел его в in_flight
+    atomic_fetch_add(&in_flight, 1);
+    if (!atomic_load(&is_running)) {
+        atomic_fetch_sub(&in_flight, 1);
+        char msg[LOG_MSG_MAX];
+        format_msg(msg, level, fmt, args);
+        va_end(args);
+        trace("%s", msg);
+        return true;
+    }
+
+    struct LogSlot *slot = NULL;
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        slot = &ring[pos & (LOG_RING_CAP - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                &enqueue_pos, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed
+            ))
+                break;
+        } else if (diff < 0) {
+            va_end(args);
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            atomic_fetch_sub(&in_flight, 1);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    format_msg(slot->msg, level, fmt, args);
+    va_end(args);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_fetch_sub(&in_flight, 1);
+    return true;
+}
+
+struct LogStats log_stats(void) {
+    return (struct LogStats) {
+        .written = atomic_load(&written),
+        .dropped = atomic_load(&dropped),
+    };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// Уровни логов с порогом на этапе сборки и запись без блокировок.
+// Сообщение форматируется в ячейку кольца на вызывающем потоке, в
+// trace() его выводит фоновый поток. Заполненное кольцо отбрасывает
+// сообщения, кадр никогда не ждет ввода-вывода.
+//
+// Порог: -DSPLITTER_LOG_LEVEL=LOG_LEVEL_WARN и т.п. По умолчанию
+// LOG_LEVEL_DEBUG с DEBUG и LOG_LEVEL_INFO без него. Вызовы ниже порога
+// не попадают в сборку вместе с аргументами.
+//
+// До log_init() и после log_shutdown() сообщения идут в trace() сразу.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE  4
+
+#ifndef SPLITTER_LOG_LEVEL
+#ifdef DEBUG
+#define SPLITTER_LOG_LEVEL  LOG_LEVEL_DEBUG
+#else
+#define SPLITTER_LOG_LEVEL  LOG_LEVEL_INFO
+#endif
+#endif
+
+// Степень двойки
+#define LOG_RING_CAP    1024
+#define LOG_MSG_MAX     248
+
+#if SPLITTER_LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...)  log_push(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...)  ((void)0)
+#endif
+
+#if SPLITTER_LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...)   log_push(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...)   ((void)0)
+#endif
+
+#if SPLITTER_LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...)   log_push(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...)   ((void)0)
+#endif
+
+#if SPLITTER_LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...)  log_push(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...)  ((void)0)
+#endif
+
+struct LogStats {
+    uint64_t    written, dropped;
+};
+
+// Запускает поток вывода
+void log_init(void);
+// Дописывает все, что осталось в кольце
+void log_shutdown(void);
+
+// Из любого потока. false - кольцо заполнено, сообщение отброшено.
+bool log_push(int level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+struct LogStats log_stats(void);
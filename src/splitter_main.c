@@ -18,13 +18,31 @@
 #include "koh_stages.h"
 #include "raylib.h"
 #include "raymath.h"
+#include "splitter_log.h"
 #include "stage_splitter.h"
 #include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 HotkeyStorage hk_store = {0};
 
+// Значение после flag или NULL
+static const char *flag_value(int argc, char **argv, const char *flag) {
+    for (int i = 1; i + 1 < argc; i++)
+        if (!strcmp(argv[i], flag))
+            return argv[i + 1];
+    return NULL;
+}
+
+static bool has_flag(int argc, char **argv, const char *flag) {
+    for (int i = 1; i < argc; i++)
+        if (!strcmp(argv[i], flag))
+            return true;
+    return false;
+}
+
 static void update() {
     hotkey_process(&hk_store);
     stage_update_active();
@@ -45,6 +63,7 @@ int main(int argc, char **argv) {
 #endif
 
     logger_init();
+    log_init();
     sc_init();
 
     hotkey_init(&hk_store);
@@ -67,6 +86,12 @@ int main(int argc, char **argv) {
 
     static struct SplitterCtx ctx = {0};
     ctx.hk_store = &hk_store;
+    // --threads N - потоки решателя физики, без флага -1: значение сцены
+    const char *threads = flag_value(argc, argv, "--threads");
+    ctx.step_threads = threads ? atoi(threads) : -1;
+    ctx.record_path = flag_value(argc, argv, "--record");
+    const char *seed = flag_value(argc, argv, "--seed");
+    ctx.seed = seed ? strtoull(seed, NULL, 10) : 0;
 
     Stage *st = stage_add(stage_splitter_new(), "splitter");
     st->data = &ctx;
@@ -75,7 +100,9 @@ int main(int argc, char **argv) {
     stage_set_active("splitter", NULL);
     SetTargetFPS(60);
 
-    stage_splitter_test();
+    // Самопроверка разрезания только по запросу, замедляет запуск
+    if (has_flag(argc, argv, "--test"))
+        stage_splitter_test();
 
 #if defined(PLATFORM_WEB)
     emscripten_set_main_loop(update, 60, 1);
@@ -89,6 +116,7 @@ int main(int argc, char **argv) {
     dev_draw_shutdown();
     hotkey_shutdown(&hk_store);
     console_shutdown();
+    log_shutdown();
     logger_shutdown();
     CloseWindow();
     return EXIT_SUCCESS;
@@ -0,0 +1,112 @@
+#include "splitter_planes.h"
+
+#include "chipmunk/chipmunk.h"
+#include "koh_logger.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+// Допуск в пикселях глифа для вершин, лежащих на плоскости
+#define PLANE_EPS   0.01
+
+// Длина ребра куска на плоскости i. 0 - на плоскости меньше двух вершин,
+// куском она не ограничивает: выпуклый многоугольник задается только
+// плоскостями своих ребер.
+static cpFloat plane_edge(
+    const struct ClipPlanes *planes, int i, const cpVect *verts, int num
+) {
+    cpFloat lo = INFINITY, hi = -INFINITY;
+    int touches = 0;
+    for (int k = 0; k < num; k++) {
+        if (cpvdot(planes->n[i], verts[k]) - planes->dist[i] <= -PLANE_EPS)
+            continue;
+        cpFloat t = cpvcross(planes->n[i], verts[k]);
+        lo = fmin(lo, t);
+        hi = fmax(hi, t);
+        touches++;
+    }
+    return touches < 2 ? 0. : hi - lo;
+}
+
+void planes_add_world(
+    struct ClipPlanes *planes, cpTransform glyph2world, cpVect n, cpFloat dist,
+    const cpVect *verts, int num
+) {
+    assert(planes);
+    assert(verts);
+    cpTransform g = glyph2world;
+    // n * (R * p + t) < dist  =>  (R^T * n) * p < dist - n * t
+    cpVect n_glyph = {
+        g.a * n.x + g.b * n.y,
+        g.c * n.x + g.d * n.y,
+    };
+    cpFloat dist_glyph = dist - cpvdot(n, (cpVect) { g.tx, g.ty });
+
+    if (planes->num == MAX_CLIP_PLANES) {
+        // Вытесняется плоскость без ребра, иначе с самым коротким ребром:
+        // маска станет шире куска меньше всего
+        int evict = 0;
+        cpFloat evict_edge = INFINITY;
+        for (int i = 0; i < planes->num; i++) {
+            cpFloat edge = plane_edge(planes, i, verts, num);
+            if (edge < evict_edge) {
+                evict = i;
+                evict_edge = edge;
+            }
+        }
+        if (evict_edge > 0.)
+            trace(
+                "planes_add_world: planes limit reached, evicting edge %f\n",
+                evict_edge
+            );
+        planes->num--;
+        planes->n[evict] = planes->n[planes->num];
+        planes->dist[evict] = planes->dist[planes->num];
+    }
+
+    planes->n[planes->num] = n_glyph;
+    planes->dist[planes->num] = dist_glyph;
+    planes->num++;
+}
+
+void planes_prune(struct ClipPlanes *planes, const cpVect *verts, int num) {
+    assert(planes);
+    assert(verts);
+    int j = 0;
+    for (int i = 0; i < planes->num; i++) {
+        bool touches = false;
+        for (int k = 0; k < num; k++) {
+            if (cpvdot(planes->n[i], verts[k]) - planes->dist[i] > -PLANE_EPS) {
+                touches = true;
+                break;
+            }
+        }
+        if (touches) {
+            planes->n[j] = planes->n[i];
+            planes->dist[j] = planes->dist[i];
+            j++;
+        }
+    }
+    planes->num = j;
+}
+
+bool planes_contains(const struct ClipPlanes *planes, cpVect p) {
+    assert(planes);
+    for (int i = 0; i < planes->num; i++)
+        if (cpvdot(planes->n[i], p) - planes->dist[i] >= 0.)
+            return false;
+    return true;
+}
+
+void planes_rasterize(
+    const struct ClipPlanes *planes, int w, int h, uint8_t *out
+) {
+    assert(planes);
+    assert(out);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            cpVect p = { x + 0.5 - w / 2., y + 0.5 - h / 2. };
+            out[y * w + x] = planes_contains(planes, p) ? 255 : 0;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+// Аналитическая маска куска: исходный прямоугольник глифа, пересеченный с
+// полуплоскостями разрезов. Плоскости хранятся в системе координат глифа
+// (начало в центре текстуры, y вниз).
+
+#include "chipmunk/chipmunk.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Должно совпадать с MAX_PLANES в assets/vertex/100_fragment_stencil.glsl
+#define MAX_CLIP_PLANES 16
+
+// Точка p внутри, если cpvdot(n[i], p) - dist[i] < 0 для всех плоскостей.
+struct ClipPlanes {
+    cpVect  n[MAX_CLIP_PLANES];
+    cpFloat dist[MAX_CLIP_PLANES];
+    int     num;
+};
+
+// Добавляет плоскость, заданную в мировых координатах. verts - вершины
+// нового куска в системе глифа. Если места нет, вытесняется плоскость,
+// которая меньше всего ограничивает кусок, см. planes_prune().
+void planes_add_world(
+    struct ClipPlanes *planes, cpTransform glyph2world, cpVect n, cpFloat dist,
+    const cpVect *verts, int num
+);
+// Удаляет плоскости, на которых не лежит ни одна вершина куска.
+// verts в системе координат глифа.
+void planes_prune(struct ClipPlanes *planes, const cpVect *verts, int num);
+
+// CPU эталон фрагментного шейдера.
+bool planes_contains(const struct ClipPlanes *planes, cpVect p);
+// Заполняет маску w * h: 255 внутри куска, 0 снаружи. Строка 0 - верх глифа.
+void planes_rasterize(
+    const struct ClipPlanes *planes, int w, int h, uint8_t *out
+);
@@ -0,0 +1,186 @@
+#include "splitter_pool.h"
+
+#include "chipmunk/chipmunk.h"
+#include "chipmunk/chipmunk_private.h"
+#include "koh_logger.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline void list_push(struct PoolNode **list, int *num, void *ptr) {
+    struct PoolNode *node = ptr;
+    node->next = *list;
+    *list = node;
+    (*num)++;
+}
+
+static inline void *list_pop(struct PoolNode **list, int *num) {
+    struct PoolNode *node = *list;
+    if (node) {
+        *list = node->next;
+        (*num)--;
+    }
+    return node;
+}
+
+static void list_free(struct PoolNode **list, int *num) {
+    struct PoolNode *node = *list;
+    while (node) {
+        struct PoolNode *next = node->next;
+        free(node);
+        node = next;
+    }
+    *list = NULL;
+    *num = 0;
+}
+
+static inline int mesh_bucket_cap(int bucket) {
+    return 4 << bucket;
+}
+
+static inline size_t mesh_block_size(int verts_cap) {
+    int tris_cap = verts_cap >= 3 ? verts_cap - 2 : 0;
+    return sizeof(cpVect) * verts_cap + sizeof(int) * tris_cap * 3;
+}
+
+// -1 если блок такого размера в списках не хранится
+static int mesh_bucket(int verts_cap) {
+    for (int i = 0; i < POOL_MESH_BUCKETS; i++)
+        if (verts_cap <= mesh_bucket_cap(i))
+            return i;
+    return -1;
+}
+
+void pool_init(struct FragmentPool *p, int max_free) {
+    assert(p);
+    assert(max_free >= 0);
+    memset(p, 0, sizeof(*p));
+    p->enabled = true;
+    p->max_free = max_free;
+}
+
+void pool_shutdown(struct FragmentPool *p) {
+    assert(p);
+    trace(
+        "pool_shutdown: bodies %d, shapes %d, free bytes %zu\n",
+        p->bodies_num, p->shapes_num, p->stats.bytes_free
+    );
+    list_free(&p->bodies, &p->bodies_num);
+    // Внешние массивы плоскостей освобождены в pool_shape_free()
+    list_free(&p->shapes, &p->shapes_num);
+    for (int i = 0; i < POOL_MESH_BUCKETS; i++)
+        list_free(&p->meshes[i], &p->meshes_num[i]);
+    p->stats.bytes_free = 0;
+}
+
+cpBody *pool_body_new(struct FragmentPool *p, cpFloat mass, cpFloat moment) {
+    assert(p);
+    cpBody *body = list_pop(&p->bodies, &p->bodies_num);
+    if (body) {
+        memset(body, 0, sizeof(*body));
+        p->stats.bodies_reused++;
+        p->stats.bytes_free -= sizeof(cpBody);
+    } else {
+        body = cpBodyAlloc();
+        assert(body);
+        p->stats.bodies_new++;
+    }
+    p->stats.bytes_live += sizeof(cpBody);
+    return cpBodyInit(body, mass, moment);
+}
+
+void pool_body_free(struct FragmentPool *p, cpBody *body) {
+    assert(p);
+    assert(body);
+    assert(!body->space);
+    assert(!body->shapeList);
+    cpBodyDestroy(body);
+    p->stats.bytes_live -= sizeof(cpBody);
+    if (!p->enabled || p->bodies_num >= p->max_free) {
+        cpfree(body);
+        return;
+    }
+    list_push(&p->bodies, &p->bodies_num, body);
+    p->stats.bytes_free += sizeof(cpBody);
+}
+
+cpShape *pool_poly_new(
+    struct FragmentPool *p, cpBody *body, int count, const cpVect *verts,
+    cpTransform transform, cpFloat radius
+) {
+    assert(p);
+    cpPolyShape *poly = list_pop(&p->shapes, &p->shapes_num);
+    if (poly) {
+        memset(poly, 0, sizeof(*poly));
+        p->stats.shapes_reused++;
+        p->stats.bytes_free -= sizeof(cpPolyShape);
+    } else {
+        poly = cpPolyShapeAlloc();
+        assert(poly);
+        p->stats.shapes_new++;
+    }
+    p->stats.bytes_live += sizeof(cpPolyShape);
+    return (cpShape*)cpPolyShapeInit(poly, body, count, verts, transform, radius);
+}
+
+void pool_shape_free(struct FragmentPool *p, cpShape *shape) {
+    assert(p);
+    assert(shape);
+    assert(shape->klass->type == CP_POLY_SHAPE);
+    assert(!shape->space);
+    // Форма с большим числом вершин держит плоскости вне структуры
+    cpShapeDestroy(shape);
+    p->stats.bytes_live -= sizeof(cpPolyShape);
+    if (!p->enabled || p->shapes_num >= p->max_free) {
+        cpfree(shape);
+        return;
+    }
+    list_push(&p->shapes, &p->shapes_num, shape);
+    p->stats.bytes_free += sizeof(cpPolyShape);
+}
+
+cpVect *pool_mesh_alloc(struct FragmentPool *p, int verts_num, int *verts_cap) {
+    assert(p);
+    assert(verts_cap);
+    assert(verts_num > 0);
+    int bucket = mesh_bucket(verts_num);
+    int cap = bucket != -1 ? mesh_bucket_cap(bucket) : verts_num;
+    size_t sz = mesh_block_size(cap);
+    cpVect *verts = NULL;
+
+    if (bucket != -1)
+        verts = list_pop(&p->meshes[bucket], &p->meshes_num[bucket]);
+    if (verts) {
+        p->stats.meshes_reused++;
+        p->stats.bytes_free -= sz;
+    } else {
+        verts = malloc(sz);
+        assert(verts);
+        p->stats.meshes_new++;
+    }
+    p->stats.bytes_live += sz;
+    *verts_cap = cap;
+    return verts;
+}
+
+void pool_mesh_free(struct FragmentPool *p, cpVect *verts, int verts_cap) {
+    assert(p);
+    if (!verts)
+        return;
+    size_t sz = mesh_block_size(verts_cap);
+    p->stats.bytes_live -= sz;
+    int bucket = mesh_bucket(verts_cap);
+    if (!p->enabled || bucket == -1 ||
+        mesh_bucket_cap(bucket) != verts_cap ||
+        p->meshes_num[bucket] >= p->max_free) {
+        free(verts);
+        return;
+    }
+    list_push(&p->meshes[bucket], &p->meshes_num[bucket], verts);
+    p->stats.bytes_free += sz;
+}
+
+uint64_t pool_heap_allocs(const struct FragmentPool *p) {
+    assert(p);
+    return p->stats.bodies_new + p->stats.shapes_new + p->stats.meshes_new;
+}
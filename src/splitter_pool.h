@@ -0,0 +1,58 @@
+#pragma once
+
+// Повторное использование памяти тел, форм и триангуляций кусков.
+// Освобожденные объекты уходят в списки свободных и выдаются снова без
+// обращения к куче. Слоты компонентов и сущности переиспользует сам de_ecs.
+
+#include "chipmunk/chipmunk.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Размеры триангуляций: 4, 8, 16, 32, 64 вершины, больше - напрямую из кучи
+#define POOL_MESH_BUCKETS   5
+
+struct PoolNode {
+    struct PoolNode *next;
+};
+
+struct FragmentPoolStats {
+    // _new - обращения к куче, _reused - выдано из списков свободных
+    uint64_t    bodies_new, bodies_reused;
+    uint64_t    shapes_new, shapes_reused;
+    uint64_t    meshes_new, meshes_reused;
+    // Байт у живых кусков и байт, лежащих в списках свободных
+    size_t      bytes_live, bytes_free;
+};
+
+struct FragmentPool {
+    // Если выключен, то каждый запрос идет в кучу, для сравнения в бенчмарке
+    bool                        enabled;
+    // Не больше стольких объектов в каждом списке, остальное в кучу
+    int                         max_free;
+    struct PoolNode             *bodies, *shapes;
+    int                         bodies_num, shapes_num;
+    struct PoolNode             *meshes[POOL_MESH_BUCKETS];
+    int                         meshes_num[POOL_MESH_BUCKETS];
+    struct FragmentPoolStats    stats;
+};
+
+void pool_init(struct FragmentPool *p, int max_free);
+void pool_shutdown(struct FragmentPool *p);
+
+cpBody *pool_body_new(struct FragmentPool *p, cpFloat mass, cpFloat moment);
+// Тело уже удалено из пространства и не имеет форм
+void pool_body_free(struct FragmentPool *p, cpBody *body);
+
+cpShape *pool_poly_new(
+    struct FragmentPool *p, cpBody *body, int count, const cpVect *verts,
+    cpTransform transform, cpFloat radius
+);
+void pool_shape_free(struct FragmentPool *p, cpShape *shape);
+
+// Блок под verts_num вершин и (verts_num - 2) * 3 индексов. Блок выделен
+// malloc(), поэтому его можно вернуть и через free().
+cpVect *pool_mesh_alloc(struct FragmentPool *p, int verts_num, int *verts_cap);
+void pool_mesh_free(struct FragmentPool *p, cpVect *verts, int verts_cap);
+
+uint64_t pool_heap_allocs(const struct FragmentPool *p);
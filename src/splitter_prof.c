@@ -0,0 +1,106 @@
+#include "splitter_prof.h"
+
+#include "koh_logger.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct ProfPhaseData {
+    double      frame;
+    double      window[PROF_WINDOW];
+    uint64_t    calls;
+};
+
+static struct ProfPhaseData phases[PROF_PHASES_NUM];
+// Кадров в кольце и индекс следующей записи
+static int frames_num = 0, frames_next = 0;
+
+double prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void prof_add(enum ProfPhase phase, double seconds) {
+    assert(phase >= 0 && phase < PROF_PHASES_NUM);
+    phases[phase].frame += seconds;
+    phases[phase].calls++;
+}
+
+void prof_frame(void) {
+    for (int i = 0; i < PROF_PHASES_NUM; i++) {
+        phases[i].window[frames_next] = phases[i].frame;
+        phases[i].frame = 0.;
+    }
+    frames_next = (frames_next + 1) % PROF_WINDOW;
+    if (frames_num < PROF_WINDOW)
+        frames_num++;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+struct ProfStats prof_stats(enum ProfPhase phase) {
+    assert(phase >= 0 && phase < PROF_PHASES_NUM);
+    struct ProfStats st = {
+        .calls = phases[phase].calls,
+    };
+    if (!frames_num)
+        return st;
+
+    double sorted[PROF_WINDOW];
+    memcpy(sorted, phases[phase].window, sizeof(sorted[0]) * frames_num);
+    qsort(sorted, frames_num, sizeof(sorted[0]), cmp_double);
+    double sum = 0.;
+    for (int i = 0; i < frames_num; i++)
+        sum += sorted[i];
+    st.min = sorted[0] * 1000.;
+    st.max = sorted[frames_num - 1] * 1000.;
+    st.avg = sum / frames_num * 1000.;
+    st.p99 = sorted[(int)((frames_num - 1) * 0.99)] * 1000.;
+    return st;
+}
+
+const char *prof_phase2str(enum ProfPhase phase) {
+    switch (phase) {
+        case PROF_UPDATE: return "update";
+        case PROF_STEP: return "step";
+        case PROF_POSTSTEP: return "poststep";
+        case PROF_UPDATE_MASK: return "update_mask";
+        case PROF_DRAW: return "draw";
+        case PROF_DRAW_CHARS: return "draw_chars";
+        case PROF_DRAW_TEXTURES_MASKS: return "draw_textures_masks";
+        case PROF_SPACE_DEBUG_DRAW: return "space_debug_draw";
+        default: return "unknown";
+    }
+}
+
+bool prof_dump_csv(const char *path) {
+    assert(path);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        trace("prof_dump_csv: could not open %s\n", path);
+        return false;
+    }
+    fprintf(f, "frame");
+    for (int i = 0; i < PROF_PHASES_NUM; i++)
+        fprintf(f, ",%s", prof_phase2str(i));
+    fprintf(f, "\n");
+
+    // От самого старого кадра к последнему
+    int first = (frames_next - frames_num + PROF_WINDOW) % PROF_WINDOW;
+    for (int k = 0; k < frames_num; k++) {
+        int j = (first + k) % PROF_WINDOW;
+        fprintf(f, "%d", k);
+        for (int i = 0; i < PROF_PHASES_NUM; i++)
+            fprintf(f, ",%.4f", phases[i].window[j] * 1000.);
+        fprintf(f, "\n");
+    }
+    bool ok = !fclose(f);
+    trace("prof_dump_csv: %s, frames %d\n", path, frames_num);
+    return ok;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Таймеры фаз кадра. Время фазы за кадр суммируется и кладется в кольцо
+// последних PROF_WINDOW кадров, по нему считаются min/avg/p99. Только
+// главный поток. Фазы могут быть вложены: шаг включает post-step.
+//
+// Собирается с -DSPLITTER_PROFILE (premake5 --profile), без него макросы
+// пустые и ничего не стоят.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROF_WINDOW     256
+
+enum ProfPhase {
+    PROF_UPDATE,
+    PROF_STEP,
+    PROF_POSTSTEP,
+    PROF_UPDATE_MASK,
+    PROF_DRAW,
+    PROF_DRAW_CHARS,
+    PROF_DRAW_TEXTURES_MASKS,
+    PROF_SPACE_DEBUG_DRAW,
+    PROF_PHASES_NUM,
+};
+
+struct ProfStats {
+    // Миллисекунды за кадр
+    double      min, avg, p99, max;
+    // Вызовов за все время
+    uint64_t    calls;
+};
+
+#ifdef SPLITTER_PROFILE
+#define PROF_BEGIN(phase)   double prof_start_##phase = prof_now()
+#define PROF_END(phase)     prof_add(phase, prof_now() - prof_start_##phase)
+#define PROF_FRAME()        prof_frame()
+#else
+#define PROF_BEGIN(phase)   ((void)0)
+#define PROF_END(phase)     ((void)0)
+#define PROF_FRAME()        ((void)0)
+#endif
+
+double prof_now(void);
+void prof_add(enum ProfPhase phase, double seconds);
+// Закрывает кадр: суммы фаз уходят в кольцо
+void prof_frame(void);
+struct ProfStats prof_stats(enum ProfPhase phase);
+const char *prof_phase2str(enum ProfPhase phase);
+// Кадры из кольца по строке, столбец на фазу, в миллисекундах
+bool prof_dump_csv(const char *path);
@@ -0,0 +1,71 @@
+#include "splitter_raster.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+void raster_convex_rows(
+    const cpVect *verts, int num, int w, int h, int y0, int y1, uint8_t *out
+) {
+    assert(verts || !num);
+    assert(out);
+    assert(w > 0 && h > 0);
+    assert(y0 >= 0 && y0 <= y1 && y1 <= h);
+
+    int rows = y1 - y0;
+    if (!rows)
+        return;
+
+    // Границы отрезка строки, пустой отрезок - xl > xr
+    float xl[rows], xr[rows];
+    for (int i = 0; i < rows; i++) {
+        xl[i] = w;
+        xr[i] = 0.f;
+    }
+
+    for (int k = 0; k < num; k++) {
+        cpVect a = verts[k], b = verts[(k + 1) % num];
+        if (a.y == b.y)
+            continue;
+        if (a.y > b.y) {
+            cpVect t = a;
+            a = b;
+            b = t;
+        }
+        // Строки, чей центр y + 0.5 лежит в [a.y, b.y)
+        int lo = ceil(a.y - 0.5), hi = ceil(b.y - 0.5);
+        if (lo < y0)
+            lo = y0;
+        if (hi > y1)
+            hi = y1;
+        if (lo >= hi)
+            continue;
+
+        float dx = (b.x - a.x) / (b.y - a.y);
+        float x = a.x + (lo + 0.5 - a.y) * dx;
+        float *l = xl + lo - y0, *r = xr + lo - y0;
+        int n = hi - lo;
+        for (int i = 0; i < n; i++) {
+            float xi = x + i * dx;
+            l[i] = xi < l[i] ? xi : l[i];
+            r[i] = xi > r[i] ? xi : r[i];
+        }
+    }
+
+    for (int i = 0; i < rows; i++) {
+        uint8_t *row = out + (size_t)(y0 + i) * w;
+        // Центр x + 0.5 лежит в [xl, xr)
+        int x0 = ceilf(xl[i] - 0.5f), x1 = ceilf(xr[i] - 0.5f);
+        if (x0 < 0)
+            x0 = 0;
+        if (x1 > w)
+            x1 = w;
+        if (x0 >= x1) {
+            memset(row, 0, w);
+            continue;
+        }
+        memset(row, 0, x0);
+        memset(row + x0, 255, x1 - x0);
+        memset(row + x1, 0, w - x1);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Растеризация выпуклого многоугольника в маску на CPU, без GPU и окна.
+// Сначала для каждой строки считается отрезок [x0, x1) по всем ребрам
+// (цикл по строкам без ветвлений, векторизуется компилятором), затем строки
+// заливаются memset. Пиксель внутри, если внутри его центр, как в
+// planes_rasterize(). Не трогает общих данных: несколько масок или полосы
+// строк одной маски можно считать в разных потоках.
+
+#include "chipmunk/chipmunk.h"
+#include <stdint.h>
+
+// verts в пикселях маски, строка 0 - верх. Порядок обхода любой.
+// Заполняет строки [y0, y1) маски w * h: 255 внутри, 0 снаружи.
+void raster_convex_rows(
+    const cpVect *verts, int num, int w, int h, int y0, int y1, uint8_t *out
+);
+
+static inline void raster_convex(
+    const cpVect *verts, int num, int w, int h, uint8_t *out
+) {
+    raster_convex_rows(verts, num, w, h, 0, h, out);
+}
+
@@ -0,0 +1,108 @@
+#include "splitter_render.h"
+
+#include "chipmunk/chipmunk.h"
+#include "chipmunk/chipmunk_private.h"
+#include "koh_logger.h"
+#include "raylib.h"
+#include "rlgl.h"
+#include "splitter_core.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+void batch_init(struct RenderBatch *b) {
+    assert(b);
+    memset(b, 0, sizeof(*b));
+    b->cap = 256;
+    b->items = calloc(b->cap, sizeof(b->items[0]));
+    assert(b->items);
+}
+
+void batch_shutdown(struct RenderBatch *b) {
+    assert(b);
+    free(b->items);
+    memset(b, 0, sizeof(*b));
+}
+
+void batch_push(
+    struct RenderBatch *b, Texture2D tex, Rectangle uv,
+    cpTransform body2world, const struct Component_Mask *m,
+    const struct Component_Mesh *mesh
+) {
+    assert(b);
+    assert(m);
+    assert(mesh);
+    if (b->num == b->cap) {
+        b->cap *= 2;
+        b->items = realloc(b->items, sizeof(b->items[0]) * b->cap);
+        assert(b->items);
+    }
+    b->items[b->num++] = (struct BatchItem) {
+        .tex_id = tex.id,
+        .uv = uv,
+        .body2world = body2world,
+        .mesh = mesh,
+        .body2glyph = cpTransformInverse(m->tr),
+        .size = m->size,
+    };
+}
+
+static int cmp_item(const void *a, const void *b) {
+    const struct BatchItem *x = a, *y = b;
+    return (x->tex_id > y->tex_id) - (x->tex_id < y->tex_id);
+}
+
+static inline void emit_vertex(const struct BatchItem *item, cpVect local) {
+    cpVect world = cpTransformPoint(item->body2world, local);
+    cpVect g = cpTransformPoint(item->body2glyph, local);
+    rlTexCoord2f(
+        item->uv.x + (g.x / item->size.x + 0.5) * item->uv.width,
+        item->uv.y + (g.y / item->size.y + 0.5) * item->uv.height
+    );
+    rlVertex2f(world.x, world.y);
+}
+
+static void emit_mesh(const struct BatchItem *item) {
+    const struct Component_Mesh *mesh = item->mesh;
+    if (!mesh->tris_num)
+        return;
+
+    rlCheckRenderBatchLimit(mesh->tris_num * 3);
+    rlBegin(RL_TRIANGLES);
+    for (int i = 0; i < mesh->tris_num * 3; i++)
+        emit_vertex(item, mesh->verts[mesh->indices[i]]);
+    rlEnd();
+}
+
+void batch_draw(struct RenderBatch *b, Color tint) {
+    assert(b);
+    memset(&b->stats, 0, sizeof(b->stats));
+    if (!b->num)
+        return;
+
+    qsort(b->items, b->num, sizeof(b->items[0]), cmp_item);
+
+    // Порядок обхода вершин у chipmunk и у экранной системы координат разный
+    rlDrawRenderBatchActive();
+    rlDisableBackfaceCulling();
+
+    unsigned int tex_id = 0;
+    for (int i = 0; i < b->num; i++) {
+        const struct BatchItem *item = &b->items[i];
+        if (item->tex_id != tex_id || i == 0) {
+            tex_id = item->tex_id;
+            rlSetTexture(tex_id);
+            b->stats.textures++;
+        }
+        rlColor4ub(tint.r, tint.g, tint.b, tint.a);
+        emit_mesh(item);
+        b->stats.triangles += item->mesh->tris_num;
+        b->stats.fragments++;
+    }
+
+    rlSetTexture(0);
+    rlDrawRenderBatchActive();
+    rlEnableBackfaceCulling();
+
+    b->num = 0;
+}
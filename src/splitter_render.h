@@ -0,0 +1,42 @@
+#pragma once
+
+// Пакетная отрисовка кусков: треугольники берутся из готовой триангуляции
+// comp_mesh, текстурные координаты - из прямоугольника глифа. Куски группируются по
+// текстуре, на каждую текстуру уходит один буфер вершин rlgl.
+
+#include "chipmunk/chipmunk.h"
+#include "raylib.h"
+#include "splitter_core.h"
+
+struct BatchItem {
+    unsigned int    tex_id;
+    // Область глифа на текстуре в нормализованных координатах. Для render
+    // texture высота отрицательная.
+    Rectangle       uv;
+    // Тело куска или частица, см. particle_transform()
+    cpTransform                 body2world;
+    const struct Component_Mesh *mesh;
+    cpTransform                 body2glyph;
+    cpVect          size;
+};
+
+struct BatchStats {
+    int textures, fragments, triangles;
+};
+
+struct RenderBatch {
+    struct BatchItem    *items;
+    int                 num, cap;
+    struct BatchStats   stats;
+};
+
+void batch_init(struct RenderBatch *b);
+void batch_shutdown(struct RenderBatch *b);
+
+void batch_push(
+    struct RenderBatch *b, Texture2D tex, Rectangle uv,
+    cpTransform body2world, const struct Component_Mask *m,
+    const struct Component_Mesh *mesh
+);
+// Рисует и очищает накопленные куски.
+void batch_draw(struct RenderBatch *b, Color tint);
@@ -0,0 +1,325 @@
+#include "splitter_replay.h"
+
+#include "koh_logger.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(
+    sizeof(struct ReplayHeader) == 32 && sizeof(struct ReplayEvent) == 12 &&
+    sizeof(struct ReplaySpawn) == 40, "replay: structs without padding"
+);
+
+// При ошибке файл закрывается, запись дальше молча не идет
+static bool record_write(
+    struct ReplayRecorder *rec, const void *data, size_t size
+) {
+    if (fwrite(data, size, 1, rec->f) == 1)
+        return true;
+    trace("record_write: write failed, recording stopped\n");
+    fclose(rec->f);
+    rec->f = NULL;
+    return false;
+}
+
+bool replay_record_open(
+    struct ReplayRecorder *rec, const char *path, uint64_t seed,
+    const struct SimClock *clock
+) {
+    assert(rec);
+    assert(path);
+    assert(clock);
+    memset(rec, 0, sizeof(*rec));
+    rec->f = fopen(path, "wb");
+    if (!rec->f) {
+        trace("replay_record_open: could not open %s\n", path);
+        return false;
+    }
+    struct ReplayHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = REPLAY_MAGIC;
+    h.version = REPLAY_VERSION;
+    h.seed = seed;
+    h.step = clock->step;
+    h.max_substeps = clock->max_substeps;
+    if (!record_write(rec, &h, sizeof(h)))
+        return false;
+    // Первые параметры пишутся всегда
+    memset(&rec->opts, 0xff, sizeof(rec->opts));
+    trace(
+        "replay_record_open: %s, seed %llu\n",
+        path, (unsigned long long)seed
+    );
+    return true;
+}
+
+void replay_record(
+    struct ReplayRecorder *rec, uint64_t step, enum ReplayEventType type,
+    const void *data, uint32_t size
+) {
+    assert(rec);
+    if (!rec->f || rec->paused)
+        return;
+    assert(step <= UINT32_MAX);
+    struct ReplayEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.step = step;
+    ev.type = type;
+    ev.size = size;
+    if (!record_write(rec, &ev, sizeof(ev)))
+        return;
+    if (size && !record_write(rec, data, size))
+        return;
+    rec->events++;
+}
+
+struct ReplayOpts replay_opts_get(const SplitterCore *core) {
+    assert(core);
+    // Через memset, чтобы выравнивание в файле было нулевым
+    struct ReplayOpts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.budget = core->budget;
+    opts.broadphase = core->broadphase;
+    opts.lod = core->lod;
+    opts.bake = core->bake;
+    return opts;
+}
+
+void replay_opts_apply(SplitterCore *core, const struct ReplayOpts *opts) {
+    assert(core);
+    assert(opts);
+    core->budget = opts->budget;
+    core->broadphase = opts->broadphase;
+    core->lod = opts->lod;
+    core->bake = opts->bake;
+}
+
+void replay_record_opts(struct ReplayRecorder *rec, const SplitterCore *core) {
+    assert(rec);
+    if (!rec->f)
+        return;
+    struct ReplayOpts opts = replay_opts_get(core);
+    if (!memcmp(&opts, &rec->opts, sizeof(opts)))
+        return;
+    rec->opts = opts;
+    replay_record(rec, core->clock.steps, REPLAY_OPTS, &opts, sizeof(opts));
+}
+
+void replay_record_close(struct ReplayRecorder *rec, uint64_t step) {
+    assert(rec);
+    if (!rec->f)
+        return;
+    rec->paused = false;
+    replay_record(rec, step, REPLAY_END, NULL, 0);
+    // Ошибка записи могла уже закрыть файл
+    if (!rec->f)
+        return;
+    if (fclose(rec->f))
+        trace("replay_record_close: close failed\n");
+    trace(
+        "replay_record_close: events %u, steps %llu\n",
+        rec->events, (unsigned long long)step
+    );
+    memset(rec, 0, sizeof(*rec));
+}
+
+void replay_record_reset(struct ReplayRecorder *rec, uint64_t step) {
+    assert(rec);
+    if (!rec->f || rec->paused)
+        return;
+    replay_record(rec, step, REPLAY_RESET, NULL, 0);
+    rec->paused = true;
+    // Параметры новой сессии пишутся заново
+    memset(&rec->opts, 0xff, sizeof(rec->opts));
+}
+
+void replay_record_resume(struct ReplayRecorder *rec) {
+    assert(rec);
+    rec->paused = false;
+}
+
+static void *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void *data = len > 0 ? malloc(len) : NULL;
+    if (data && fread(data, len, 1, f) != 1) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = data ? len : 0;
+    return data;
+}
+
+static void replay_summary(SplitterCore *core, struct ReplayStats *stats) {
+    stats->bodies = core_body_count(core);
+    stats->fragments = core_fragment_count(core);
+    stats->particles = core_particle_count(core);
+    stats->checksum = 0.;
+    de_view_single view = de_create_view_single(core->r, comp_body);
+    while (de_view_single_valid(&view)) {
+        struct Component_Body *b = de_view_single_get(&view);
+        cpVect p = cpBodyGetPosition(b->b);
+        stats->checksum += p.x + p.y + cpBodyGetAngle(b->b);
+        de_view_single_next(&view);
+    }
+}
+
+// Один шаг часов, как в кадре с frame_dt == step
+static void replay_step(
+    SplitterCore *core, FILE *timing, struct ReplayStats *stats
+) {
+    double start = core_time();
+    core_advance(core, core->clock.step);
+    double dt = core_time() - start;
+    stats->steps++;
+    stats->total += dt;
+    if (dt > stats->worst)
+        stats->worst = dt;
+    if (timing)
+        fprintf(
+            timing, "%llu,%.4f,%d,%d\n",
+            (unsigned long long)core->clock.steps, dt * 1000.,
+            core_body_count(core), core_fragment_count(core)
+        );
+}
+
+// Размер данных события против ожидаемого, файл не доверенный
+static bool event_size_ok(const struct ReplayEvent *ev, size_t expected) {
+    if (ev->size == expected)
+        return true;
+    trace(
+        "replay_run: event %d at step %u has size %u, expected %zu\n",
+        ev->type, ev->step, ev->size, expected
+    );
+    return false;
+}
+
+static void replay_core_init(
+    SplitterCore *core, const struct ReplayHeader *h
+) {
+    core_init(core);
+    core->clock.step = h->step;
+    core->clock.max_substeps = h->max_substeps;
+}
+
+bool replay_run(const char *path, FILE *timing, struct ReplayStats *stats) {
+    assert(path);
+    assert(stats);
+    memset(stats, 0, sizeof(*stats));
+
+    size_t size = 0;
+    uint8_t *data = read_file(path, &size);
+    if (!data) {
+        trace("replay_run: could not read %s\n", path);
+        return false;
+    }
+    const struct ReplayHeader *h = (const struct ReplayHeader*)data;
+    if (size < sizeof(*h) || h->magic != REPLAY_MAGIC ||
+        h->version != REPLAY_VERSION || h->step <= 0. ||
+        h->max_substeps <= 0) {
+        trace("replay_run: %s is not a replay\n", path);
+        free(data);
+        return false;
+    }
+
+    SplitterCore core = {0};
+    replay_core_init(&core, h);
+    if (timing)
+        fprintf(timing, "step,ms,bodies,fragments\n");
+
+    de_entity last = de_null;
+    bool ended = false, ok = true;
+    size_t pos = sizeof(*h);
+    while (ok && !ended && pos + sizeof(struct ReplayEvent) <= size) {
+        struct ReplayEvent ev;
+        memcpy(&ev, data + pos, sizeof(ev));
+        pos += sizeof(ev);
+        if (ev.size > size - pos) {
+            trace("replay_run: truncated event at %zu\n", pos);
+            ok = false;
+            break;
+        }
+        const void *payload = data + pos;
+        pos += ev.size;
+
+        while (core.clock.steps < ev.step)
+            replay_step(&core, timing, stats);
+
+        switch (ev.type) {
+            case REPLAY_WALLS:
+                core_create_floor_and_walls(&core);
+                break;
+            case REPLAY_SPAWN: {
+                struct ReplaySpawn s;
+                if (!(ok = event_size_ok(&ev, sizeof(s))))
+                    break;
+                memcpy(&s, payload, sizeof(s));
+                last = core_create_box(&core, s.center, s.wh);
+                break;
+            }
+            case REPLAY_DIAGONAL:
+                if (last != de_null)
+                    core_diagonal_slice(&core, last);
+                break;
+            case REPLAY_SLICE: {
+                int num = ev.size / sizeof(cpVect);
+                if (ev.size % sizeof(cpVect) || num < 2) {
+                    trace(
+                        "replay_run: slice at step %u has size %u\n",
+                        ev.step, ev.size
+                    );
+                    ok = false;
+                    break;
+                }
+                cpVect *pts = malloc(ev.size);
+                assert(pts);
+                memcpy(pts, payload, ev.size);
+                core_slice_polyline(&core, pts, num);
+                free(pts);
+                break;
+            }
+            case REPLAY_GRAVITY: {
+                cpVect g;
+                if (!(ok = event_size_ok(&ev, sizeof(g))))
+                    break;
+                memcpy(&g, payload, sizeof(g));
+                cpSpaceSetGravity(core.space, g);
+                break;
+            }
+            case REPLAY_OPTS: {
+                struct ReplayOpts opts;
+                if (!(ok = event_size_ok(&ev, sizeof(opts))))
+                    break;
+                memcpy(&opts, payload, sizeof(opts));
+                replay_opts_apply(&core, &opts);
+                break;
+            }
+            case REPLAY_RESET:
+                core_shutdown(&core);
+                memset(&core, 0, sizeof(core));
+                replay_core_init(&core, h);
+                last = de_null;
+                break;
+            case REPLAY_END:
+                ended = true;
+                break;
+            default:
+                trace("replay_run: unknown event %d\n", ev.type);
+                break;
+        }
+        stats->events++;
+    }
+    if (ok && !ended)
+        trace("replay_run: %s has no end marker\n", path);
+
+    if (ok)
+        replay_summary(&core, stats);
+    core_shutdown(&core);
+    free(data);
+    return ok;
+}
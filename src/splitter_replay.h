@@ -0,0 +1,121 @@
+#pragma once
+
+// Журнал действий игрока для воспроизведения без окна. События привязаны к
+// номеру шага SimClock: событие с шагом N применяется, когда сделано ровно
+// N шагов. Воспроизведение идет так быстро, как позволяет процессор, и
+// выдает время каждого шага. См. splitter_bench replay.
+//
+// Формат: ReplayHeader, затем ReplayEvent и size байт данных события.
+// Структуры без неявного выравнивания, файл побайтно воспроизводим.
+// Последнее событие - REPLAY_END. Порядок байт платформы. Файл пишется один
+// раз за процесс, каждый сброс сцены отделяется событием REPLAY_RESET.
+
+#include "splitter_core.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define REPLAY_MAGIC    0x524c5053u     // "SPLR"
+#define REPLAY_VERSION  1
+
+enum ReplayEventType {
+    // Пол и стены, без данных
+    REPLAY_WALLS,
+    // ReplaySpawn
+    REPLAY_SPAWN,
+    // Диагональный разрез последнего созданного глифа, без данных
+    REPLAY_DIAGONAL,
+    // Ломаная разреза, cpVect[]
+    REPLAY_SLICE,
+    // cpVect
+    REPLAY_GRAVITY,
+    // ReplayOpts
+    REPLAY_OPTS,
+    // Конец записи, без данных
+    REPLAY_END,
+    // Сцена пересоздана, шаги следующей сессии снова с 0. Без данных
+    REPLAY_RESET,
+};
+
+struct ReplayHeader {
+    uint32_t    magic, version;
+    // Зерно генератора, которым выбирались глифы при записи
+    uint64_t    seed;
+    double      step;
+    int32_t     max_substeps;
+    // Явный хвост вместо выравнивания, пишется нулем
+    int32_t     reserved;
+};
+
+struct ReplayEvent {
+    uint32_t    step;
+    uint16_t    type;
+    uint16_t    reserved;
+    uint32_t    size;
+};
+
+// Глиф на воспроизведении - только коробка того же размера
+struct ReplaySpawn {
+    cpVect      center, wh;
+    int32_t     ch;
+    int32_t     reserved;
+};
+
+// Параметры ядра, влияющие на симуляцию
+struct ReplayOpts {
+    struct FragmentBudget   budget;
+    struct BroadphaseOpts   broadphase;
+    struct ParticleLod      lod;
+    struct BakeOpts         bake;
+};
+
+// Ошибка записи закрывает файл, дальнейшие события отбрасываются
+struct ReplayRecorder {
+    FILE                *f;
+    uint32_t            events;
+    // Между сбросом и началом новой сессии события не пишутся
+    bool                paused;
+    // Последние записанные параметры, запись только при изменении
+    struct ReplayOpts   opts;
+};
+
+struct ReplayStats {
+    uint64_t    steps, events;
+    double      total, worst;
+    // Сводка конечного состояния для сравнения сборок
+    int         bodies, fragments, particles;
+    cpFloat     checksum;
+};
+
+// xorshift64*, state не должен быть 0
+static inline uint32_t replay_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (x * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+bool replay_record_open(
+    struct ReplayRecorder *rec, const char *path, uint64_t seed,
+    const struct SimClock *clock
+);
+void replay_record(
+    struct ReplayRecorder *rec, uint64_t step, enum ReplayEventType type,
+    const void *data, uint32_t size
+);
+// Пишет REPLAY_OPTS, если параметры ядра изменились с прошлой записи
+void replay_record_opts(struct ReplayRecorder *rec, const SplitterCore *core);
+void replay_record_close(struct ReplayRecorder *rec, uint64_t step);
+// Закрывает сессию событием REPLAY_RESET и останавливает запись до
+// replay_record_resume(). Сцена из снимка не воспроизводима и не пишется.
+void replay_record_reset(struct ReplayRecorder *rec, uint64_t step);
+void replay_record_resume(struct ReplayRecorder *rec);
+
+struct ReplayOpts replay_opts_get(const SplitterCore *core);
+void replay_opts_apply(SplitterCore *core, const struct ReplayOpts *opts);
+
+// timing - если не NULL, строки "шаг,мс,тела,куски" на каждый шаг.
+// false - файл не открылся или поврежден, stats тогда не заполнены.
+bool replay_run(const char *path, FILE *timing, struct ReplayStats *stats);
@@ -0,0 +1,118 @@
+#include "splitter_sdf.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define SDF_INF 1e20f
+
+static inline float parabola_cross(const float *f, int q, int r) {
+    return ((f[q] + (float)q * q) - (f[r] + (float)r * r)) / (2.f * (q - r));
+}
+
+// Квадрат расстояния до ближайшей точки с f == 0 вдоль одной линии
+static void edt_1d(const float *f, int n, float *d, int *v, float *z) {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -SDF_INF;
+    z[1] = SDF_INF;
+    for (int q = 1; q < n; q++) {
+        float s = parabola_cross(f, q, v[k]);
+        while (s <= z[k]) {
+            k--;
+            s = parabola_cross(f, q, v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = SDF_INF;
+    }
+    k = 0;
+    for (int q = 0; q < n; q++) {
+        while (z[k + 1] < q)
+            k++;
+        float dq = q - v[k];
+        d[q] = dq * dq + f[v[k]];
+    }
+}
+
+// grid на входе: 0 у точек множества, SDF_INF у остальных
+static void edt_2d(
+    float *grid, int w, int h, float *f, float *d, int *v, float *z
+) {
+    for (int x = 0; x < w; x++) {
+        for (int y = 0; y < h; y++)
+            f[y] = grid[y * w + x];
+        edt_1d(f, h, d, v, z);
+        for (int y = 0; y < h; y++)
+            grid[y * w + x] = d[y];
+    }
+    for (int y = 0; y < h; y++) {
+        edt_1d(grid + y * w, w, d, v, z);
+        for (int x = 0; x < w; x++)
+            grid[y * w + x] = d[x];
+    }
+}
+
+static inline float sample(const float *dist, int w, int h, float x, float y) {
+    x = fminf(fmaxf(x, 0.f), w - 1.f);
+    y = fminf(fmaxf(y, 0.f), h - 1.f);
+    int x0 = x, y0 = y;
+    int x1 = x0 + 1 < w ? x0 + 1 : x0, y1 = y0 + 1 < h ? y0 + 1 : y0;
+    float tx = x - x0, ty = y - y0;
+    float top = dist[y0 * w + x0] * (1.f - tx) + dist[y0 * w + x1] * tx;
+    float bottom = dist[y1 * w + x0] * (1.f - tx) + dist[y1 * w + x1] * tx;
+    return top * (1.f - ty) + bottom * ty;
+}
+
+void sdf_generate(
+    const uint8_t *alpha, int w, int h, int scale, float spread, uint8_t *out
+) {
+    assert(alpha);
+    assert(out);
+    assert(w > 0 && h > 0);
+    assert(scale > 0);
+    assert(spread > 0.f);
+
+    int n = w > h ? w : h;
+    float *inside = malloc(sizeof(float) * w * h);
+    float *outside = malloc(sizeof(float) * w * h);
+    float *f = malloc(sizeof(float) * n);
+    float *d = malloc(sizeof(float) * n);
+    float *z = malloc(sizeof(float) * (n + 1));
+    int *v = malloc(sizeof(int) * n);
+    assert(inside && outside && f && d && z && v);
+
+    // inside - расстояние до ближайшей внутренней точки, outside - до внешней
+    for (int i = 0; i < w * h; i++) {
+        bool in = alpha[i] >= 128;
+        inside[i] = in ? 0.f : SDF_INF;
+        outside[i] = in ? SDF_INF : 0.f;
+    }
+    edt_2d(inside, w, h, f, d, v, z);
+    edt_2d(outside, w, h, f, d, v, z);
+
+    // Граница проходит посередине между соседними пикселями
+    for (int i = 0; i < w * h; i++)
+        inside[i] = inside[i] > 0.f ?
+            sqrtf(inside[i]) - 0.5f : 0.5f - sqrtf(outside[i]);
+
+    int out_w = sdf_size(w, scale), out_h = sdf_size(h, scale);
+    float k = 127.f / (spread * scale);
+    for (int y = 0; y < out_h; y++)
+        for (int x = 0; x < out_w; x++) {
+            float sx = (x + 0.5f) * scale - 0.5f;
+            float sy = (y + 0.5f) * scale - 0.5f;
+            float dist = sample(inside, w, h, sx, sy);
+            float value = 128.f - dist * k;
+            out[y * out_w + x] = value < 0.f ? 0 : value > 255.f ? 255 : value;
+        }
+
+    free(inside);
+    free(outside);
+    free(f);
+    free(d);
+    free(z);
+    free(v);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Поле расстояний со знаком из маски покрытия, на CPU. Точное евклидово
+// расстояние (Felzenszwalb, Huttenlocher), затем уменьшение в scale раз.
+// Без зависимостей от окна, проверяется в splitter_bench sdf.
+
+#include <stdint.h>
+
+// Размер выхода по одной оси
+static inline int sdf_size(int size, int scale) {
+    return (size + scale - 1) / scale;
+}
+
+// alpha - w x h, значение >= 128 внутри фигуры. out - sdf_size(w, scale) x
+// sdf_size(h, scale). 128 на границе, больше внутри. spread - расстояние в
+// выходных текселях, которое укладывается в 0..127 по каждую сторону.
+void sdf_generate(
+    const uint8_t *alpha, int w, int h, int scale, float spread, uint8_t *out
+);
+
+// Расстояние в пикселях исходной маски из значения поля, больше 0 снаружи
+static inline float sdf_decode(uint8_t value, int scale, float spread) {
+    return (128.f - value) / 127.f * spread * scale;
+}
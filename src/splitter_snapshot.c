@@ -0,0 +1,334 @@
+#include "splitter_snapshot.h"
+
+#include "koh_logger.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct SnapshotWriter {
+    struct SnapshotFragment *fragments;
+    struct SnapshotParticle *particles;
+    cpVect                  *verts;
+    int                     verts_num, verts_cap;
+    struct SnapshotTag      *tags;
+    int                     tags_num, tags_cap;
+};
+
+static int writer_verts(
+    struct SnapshotWriter *w, const struct Component_Mesh *mesh
+) {
+    if (w->verts_num + mesh->verts_num > w->verts_cap) {
+        while (w->verts_num + mesh->verts_num > w->verts_cap)
+            w->verts_cap = w->verts_cap ? w->verts_cap * 2 : 4096;
+        w->verts = realloc(w->verts, sizeof(w->verts[0]) * w->verts_cap);
+        assert(w->verts);
+    }
+    int first = w->verts_num;
+    memcpy(
+        w->verts + first, mesh->verts, sizeof(mesh->verts[0]) * mesh->verts_num
+    );
+    w->verts_num += mesh->verts_num;
+    return first;
+}
+
+// Меток немного, линейный поиск
+static int writer_tag(struct SnapshotWriter *w, const char *str) {
+    if (!str)
+        return -1;
+    for (int i = 0; i < w->tags_num; i++)
+        if (!strncmp(w->tags[i].str, str, SNAPSHOT_TAG_MAX - 1))
+            return i;
+    if (w->tags_num == w->tags_cap) {
+        w->tags_cap = w->tags_cap ? w->tags_cap * 2 : 32;
+        w->tags = realloc(w->tags, sizeof(w->tags[0]) * w->tags_cap);
+        assert(w->tags);
+    }
+    struct SnapshotTag *t = &w->tags[w->tags_num];
+    memset(t, 0, sizeof(*t));
+    strncpy(t->str, str, SNAPSHOT_TAG_MAX - 1);
+    return w->tags_num++;
+}
+
+// Общая часть куска и частицы
+static void writer_entity(
+    struct SnapshotWriter *w, SplitterCore *core, de_entity e,
+    SnapshotTagFunc tag, void *udata, struct Component_Mask *mask,
+    int32_t *verts_first, int32_t *verts_num, int32_t *tag_index,
+    int32_t *has_mask
+) {
+    struct Component_Mesh *mesh = de_get(core->r, e, comp_mesh);
+    *verts_first = writer_verts(w, mesh);
+    *verts_num = mesh->verts_num;
+    struct Component_Mask *m = de_try_get(core->r, e, comp_mask);
+    *has_mask = m != NULL;
+    if (m)
+        *mask = *m;
+    *tag_index = writer_tag(w, tag ? tag(core, e, udata) : NULL);
+}
+
+static bool write_all(
+    const char *path, const struct SnapshotHeader *h,
+    const struct SnapshotWriter *w
+) {
+    // Через временный файл, чтобы прерванная запись не оставила битый снимок
+    char tmp_path[512] = {0};
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        trace("snapshot_save: could not open %s\n", tmp_path);
+        return false;
+    }
+    bool ok = fwrite(h, sizeof(*h), 1, f) == 1 &&
+        fwrite(w->fragments, sizeof(w->fragments[0]), h->fragments_num, f) ==
+            (size_t)h->fragments_num &&
+        fwrite(w->particles, sizeof(w->particles[0]), h->particles_num, f) ==
+            (size_t)h->particles_num &&
+        fwrite(w->verts, sizeof(w->verts[0]), h->verts_num, f) ==
+            (size_t)h->verts_num &&
+        fwrite(w->tags, sizeof(w->tags[0]), h->tags_num, f) ==
+            (size_t)h->tags_num;
+    ok = !fclose(f) && ok;
+    if (!ok || rename(tmp_path, path)) {
+        trace("snapshot_save: could not write %s\n", path);
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+bool snapshot_save(
+    SplitterCore *core, const char *path, SnapshotTagFunc tag, void *udata
+) {
+    assert(core);
+    assert(path);
+    double time_start = core_time();
+
+    struct SnapshotWriter w = {0};
+    w.fragments = calloc(
+        core->fragments_num ? core->fragments_num : 1, sizeof(w.fragments[0])
+    );
+    w.particles = calloc(
+        core->particles_num ? core->particles_num : 1, sizeof(w.particles[0])
+    );
+    assert(w.fragments);
+    assert(w.particles);
+
+    for (int i = 0; i < core->fragments_num; i++) {
+        de_entity e = core->fragments[i];
+        struct SnapshotFragment *sf = &w.fragments[i];
+        sf->state = core_fragment_state(core, e);
+        writer_entity(
+            &w, core, e, tag, udata, &sf->mask,
+            &sf->verts_first, &sf->verts_num, &sf->tag, &sf->has_mask
+        );
+    }
+    for (int i = 0; i < core->particles_num; i++) {
+        struct SnapshotParticle *sp = &w.particles[i];
+        sp->pt = core->particles[i];
+        writer_entity(
+            &w, core, sp->pt.e, tag, udata, &sp->mask,
+            &sp->verts_first, &sp->verts_num, &sp->tag, &sp->has_mask
+        );
+    }
+
+    struct SnapshotHeader h = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .steps = core->clock.steps,
+        .fragments_serial = core->fragments_serial,
+        .step = core->clock.step,
+        .gravity = cpSpaceGetGravity(core->space),
+        .fragments_num = core->fragments_num,
+        .particles_num = core->particles_num,
+        .verts_num = w.verts_num,
+        .tags_num = w.tags_num,
+    };
+    bool ok = write_all(path, &h, &w);
+    trace(
+        "snapshot_save: %s, fragments %d particles %d verts %d, %.3f ms\n",
+        path, h.fragments_num, h.particles_num, h.verts_num,
+        (core_time() - time_start) * 1000.
+    );
+
+    free(w.fragments);
+    free(w.particles);
+    free(w.verts);
+    free(w.tags);
+    return ok;
+}
+
+static bool snapshot_valid(const struct SnapshotHeader *h, size_t size) {
+    if (size < sizeof(*h) || h->magic != SNAPSHOT_MAGIC ||
+        h->version != SNAPSHOT_VERSION)
+        return false;
+    if (h->fragments_num < 0 || h->particles_num < 0 || h->verts_num < 0 ||
+        h->tags_num < 0)
+        return false;
+    // core_advance() делит на шаг
+    if (!isfinite(h->step) || h->step <= 0. ||
+        !isfinite(h->gravity.x) || !isfinite(h->gravity.y))
+        return false;
+    size_t need = sizeof(*h) +
+        sizeof(struct SnapshotFragment) * h->fragments_num +
+        sizeof(struct SnapshotParticle) * h->particles_num +
+        sizeof(cpVect) * h->verts_num +
+        sizeof(struct SnapshotTag) * h->tags_num;
+    return need <= size;
+}
+
+// Без переполнения int: заголовок из файла может быть любым
+static bool range_valid(
+    const struct SnapshotHeader *h, int first, int num, int tag
+) {
+    return first >= 0 && num >= 3 && num <= h->verts_num - first &&
+        tag >= -1 && tag < h->tags_num;
+}
+
+static bool mask_valid(const struct Component_Mask *mask, bool has_mask) {
+    return !has_mask ||
+        (mask->planes.num >= 0 && mask->planes.num <= MAX_CLIP_PLANES);
+}
+
+static bool vect_finite(cpVect v) {
+    return isfinite(v.x) && isfinite(v.y);
+}
+
+static bool verts_finite(const cpVect *verts, int num) {
+    for (int i = 0; i < num; i++)
+        if (!vect_finite(verts[i]))
+            return false;
+    return true;
+}
+
+// Площадь уходит в массу и момент тела, chipmunk падает на нулевой массе
+static bool state_valid(const struct FragmentState *s) {
+    return isfinite(s->area) && s->area > 0. &&
+        vect_finite(s->p) && vect_finite(s->v) &&
+        isfinite(s->a) && isfinite(s->w) && isfinite(s->friction);
+}
+
+static bool particle_valid(const struct Particle *pt) {
+    return vect_finite(pt->p) && vect_finite(pt->v) &&
+        isfinite(pt->a) && isfinite(pt->w) && isfinite(pt->life);
+}
+
+// Метки уходят в on_restore как строки C
+static bool tags_valid(const struct SnapshotTag *tags, int num) {
+    for (int i = 0; i < num; i++)
+        if (!memchr(tags[i].str, 0, SNAPSHOT_TAG_MAX))
+            return false;
+    return true;
+}
+
+static void restore_mask(
+    SplitterCore *core, de_entity e, const struct Component_Mask *mask,
+    bool has_mask
+) {
+    if (has_mask)
+        *(struct Component_Mask*)de_emplace(core->r, e, comp_mask) = *mask;
+}
+
+bool snapshot_load(
+    SplitterCore *core, const char *path, SnapshotRestoreFunc on_restore,
+    void *udata
+) {
+    assert(core);
+    assert(path);
+    assert(core->fragments_num == 0);
+    double time_start = core_time();
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        trace("snapshot_load: could not open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return false;
+    }
+    size_t map_size = st.st_size;
+    void *map = map_size ?
+        mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        trace("snapshot_load: mmap failed for %s\n", path);
+        return false;
+    }
+
+    const struct SnapshotHeader *h = map;
+    if (!snapshot_valid(h, map_size)) {
+        trace("snapshot_load: %s is not a snapshot\n", path);
+        munmap(map, map_size);
+        return false;
+    }
+    const struct SnapshotFragment *fragments = (const void*)(h + 1);
+    const struct SnapshotParticle *particles = (const void*)(
+        fragments + h->fragments_num
+    );
+    const cpVect *verts = (const void*)(particles + h->particles_num);
+    const struct SnapshotTag *tags = (const void*)(verts + h->verts_num);
+    if (!tags_valid(tags, h->tags_num)) {
+        trace("snapshot_load: %s has a tag without terminator\n", path);
+        munmap(map, map_size);
+        return false;
+    }
+
+    core->clock.steps = h->steps;
+    core->clock.step = h->step;
+    cpSpaceSetGravity(core->space, h->gravity);
+
+    int skipped = 0;
+    for (int i = 0; i < h->fragments_num; i++) {
+        const struct SnapshotFragment *sf = &fragments[i];
+        if (!range_valid(h, sf->verts_first, sf->verts_num, sf->tag) ||
+            !mask_valid(&sf->mask, sf->has_mask) ||
+            !state_valid(&sf->state) ||
+            !verts_finite(verts + sf->verts_first, sf->verts_num)) {
+            skipped++;
+            continue;
+        }
+        de_entity e = core_restore_fragment(
+            core, &sf->state, verts + sf->verts_first, sf->verts_num
+        );
+        restore_mask(core, e, &sf->mask, sf->has_mask);
+        if (on_restore)
+            on_restore(
+                core, e, sf->tag >= 0 ? tags[sf->tag].str : NULL, udata
+            );
+    }
+    for (int i = 0; i < h->particles_num; i++) {
+        const struct SnapshotParticle *sp = &particles[i];
+        if (!range_valid(h, sp->verts_first, sp->verts_num, sp->tag) ||
+            !mask_valid(&sp->mask, sp->has_mask) ||
+            !particle_valid(&sp->pt) ||
+            !verts_finite(verts + sp->verts_first, sp->verts_num)) {
+            skipped++;
+            continue;
+        }
+        de_entity e = core_restore_particle(
+            core, &sp->pt, verts + sp->verts_first, sp->verts_num
+        );
+        restore_mask(core, e, &sp->mask, sp->has_mask);
+        if (on_restore)
+            on_restore(
+                core, e, sp->tag >= 0 ? tags[sp->tag].str : NULL, udata
+            );
+    }
+    if (core->fragments_serial < h->fragments_serial)
+        core->fragments_serial = h->fragments_serial;
+
+    trace(
+        "snapshot_load: %s, fragments %d particles %d skipped %d, %.3f ms\n",
+        path, h->fragments_num, h->particles_num, skipped,
+        (core_time() - time_start) * 1000.
+    );
+    munmap(map, map_size);
+    return true;
+}
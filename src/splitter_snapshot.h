@@ -0,0 +1,68 @@
+#pragma once
+
+// Снимок мира разрезателя в плоском файле. Загрузка отображает файл в память
+// и создает куски прямо из него, без повторных разрезов и запекания строк.
+// Подходит как готовая сцена для splitter_bench.
+//
+// Формат: SnapshotHeader, fragments_num * SnapshotFragment,
+// particles_num * SnapshotParticle, verts_num * cpVect, tags_num *
+// SnapshotTag. Порядок байт и выравнивание платформы.
+//
+// Статическая геометрия (пол, стены) в снимок не входит, ее создает
+// вызывающий до snapshot_load().
+
+#include "splitter_core.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC      0x534c5053u     // "SPLS"
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_TAG_MAX    64
+
+struct SnapshotHeader {
+    uint32_t    magic, version;
+    uint64_t    steps, fragments_serial;
+    double      step;
+    cpVect      gravity;
+    int32_t     fragments_num, particles_num, verts_num, tags_num;
+};
+
+// Метка сущности вне ядра, например строка глифа текстуры
+struct SnapshotTag {
+    char    str[SNAPSHOT_TAG_MAX];
+};
+
+struct SnapshotFragment {
+    struct FragmentState    state;
+    struct Component_Mask   mask;
+    int32_t                 verts_first, verts_num;
+    // Индекс в таблице меток, -1 - без метки
+    int32_t                 tag;
+    int32_t                 has_mask;
+};
+
+struct SnapshotParticle {
+    struct Particle         pt;
+    struct Component_Mask   mask;
+    int32_t                 verts_first, verts_num;
+    int32_t                 tag;
+    int32_t                 has_mask;
+};
+
+// Метка сущности для записи, NULL - без метки
+typedef const char *(*SnapshotTagFunc)(
+    SplitterCore *core, de_entity e, void *udata
+);
+// Вызывается для каждой воссозданной сущности с ее меткой или NULL
+typedef void (*SnapshotRestoreFunc)(
+    SplitterCore *core, de_entity e, const char *tag, void *udata
+);
+
+bool snapshot_save(
+    SplitterCore *core, const char *path, SnapshotTagFunc tag, void *udata
+);
+// core после core_init() без кусков
+bool snapshot_load(
+    SplitterCore *core, const char *path, SnapshotRestoreFunc on_restore,
+    void *udata
+);
@@ -0,0 +1,119 @@
+#include "splitter_workers.h"
+
+#include "koh_logger.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct WorkerArg {
+    struct WorkerPool   *w;
+    int                 worker;
+};
+
+static void run_jobs(struct WorkerPool *w, int worker) {
+    for (;;) {
+        int i = atomic_fetch_add(&w->next, 1);
+        if (i >= w->jobs_num)
+            break;
+        w->job(w->udata, i, worker);
+    }
+}
+
+static void *worker_thread(void *arg) {
+    struct WorkerArg a = *(struct WorkerArg*)arg;
+    free(arg);
+    struct WorkerPool *w = a.w;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->generation == seen && !w->quit)
+            pthread_cond_wait(&w->cond_work, &w->lock);
+        if (w->quit)
+            break;
+        seen = w->generation;
+        pthread_mutex_unlock(&w->lock);
+
+        run_jobs(w, a.worker);
+
+        pthread_mutex_lock(&w->lock);
+        if (--w->busy == 0)
+            pthread_cond_signal(&w->cond_done);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+void workers_init(struct WorkerPool *w, int threads_num) {
+    assert(w);
+    assert(threads_num >= 0);
+    memset(w, 0, sizeof(*w));
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond_work, NULL);
+    pthread_cond_init(&w->cond_done, NULL);
+    atomic_init(&w->next, 0);
+    if (!threads_num)
+        return;
+
+    w->threads = calloc(threads_num, sizeof(w->threads[0]));
+    assert(w->threads);
+    for (int i = 0; i < threads_num; i++) {
+        struct WorkerArg *arg = malloc(sizeof(*arg));
+        assert(arg);
+        arg->w = w;
+        arg->worker = i + 1;
+        if (pthread_create(&w->threads[i], NULL, worker_thread, arg)) {
+            trace("workers_init: could not create thread %d\n", i);
+            free(arg);
+            break;
+        }
+        w->threads_num++;
+    }
+    trace("workers_init: %d threads\n", w->threads_num);
+}
+
+void workers_shutdown(struct WorkerPool *w) {
+    assert(w);
+    pthread_mutex_lock(&w->lock);
+    w->quit = true;
+    pthread_cond_broadcast(&w->cond_work);
+    pthread_mutex_unlock(&w->lock);
+    for (int i = 0; i < w->threads_num; i++)
+        pthread_join(w->threads[i], NULL);
+    free(w->threads);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond_work);
+    pthread_cond_destroy(&w->cond_done);
+    memset(w, 0, sizeof(*w));
+}
+
+void workers_run(struct WorkerPool *w, WorkerJob job, void *udata, int num) {
+    assert(w);
+    assert(job);
+    if (num <= 0)
+        return;
+
+    // Одна задача или нет потоков - без синхронизации
+    if (!w->threads_num || num == 1) {
+        for (int i = 0; i < num; i++)
+            job(udata, i, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->job = job;
+    w->udata = udata;
+    w->jobs_num = num;
+    atomic_store(&w->next, 0);
+    w->busy = w->threads_num;
+    w->generation++;
+    pthread_cond_broadcast(&w->cond_work);
+    pthread_mutex_unlock(&w->lock);
+
+    run_jobs(w, 0);
+
+    pthread_mutex_lock(&w->lock);
+    while (w->busy)
+        pthread_cond_wait(&w->cond_done, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
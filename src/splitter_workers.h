@@ -0,0 +1,32 @@
+#pragma once
+
+// Пул потоков для параллельного цикла: workers_run() раздает индексы
+// [0, num) потокам пула и главному потоку и ждет, пока все закончат.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// worker - 0 для главного потока, 1..threads_num для потоков пула
+typedef void (*WorkerJob)(void *udata, int index, int worker);
+
+struct WorkerPool {
+    pthread_t       *threads;
+    int             threads_num;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond_work, cond_done;
+    // Текущий вызов workers_run()
+    WorkerJob       job;
+    void            *udata;
+    int             jobs_num;
+    atomic_int      next;
+    int             busy;
+    uint64_t        generation;
+    bool            quit;
+};
+
+// threads_num == 0 - все выполняется в главном потоке
+void workers_init(struct WorkerPool *w, int threads_num);
+void workers_shutdown(struct WorkerPool *w);
+void workers_run(struct WorkerPool *w, WorkerJob job, void *udata, int num);
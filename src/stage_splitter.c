@@ -13,12 +13,24 @@
 #include "koh_render.h"
 #include "koh_render.h"
 #include "koh_routine.h"
+#include "koh_script.h"
 #include "koh_stages.h"
 #include "raylib.h"
 #include "raymath.h"
+#include "lua.h"
+#include "splitter_atlas.h"
+#include "splitter_core.h"
+#include "splitter_dump.h"
+#include "splitter_glyphs.h"
+#include "splitter_log.h"
+#include "splitter_prof.h"
+#include "splitter_render.h"
+#include "splitter_replay.h"
+#include "splitter_snapshot.h"
 #include "stage_splitter.h"
 #include <assert.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "rlgl.h"
 
@@ -31,58 +43,96 @@ static cpVect gravity = { 0, 9.8 * 20. };
 static bool use_gravity = false;
 static cpBool lastClickState = cpFalse;
 static cpVect sliceStart = {0.0, 0.0};
+
+#define MAX_SWIPE_POINTS    256
+// Ломаная жеста разреза в мировых координатах
+static cpVect swipe[MAX_SWIPE_POINTS];
+static int swipe_num = 0;
+// Минимальное расстояние между соседними точками ломаной
+static const float swipe_step = 20.;
 static Font fnt = {0};
+// Шрифт из файла атласа, иначе растеризован при запуске
+static bool fnt_from_atlas = false;
 static bool is_paused = false;
 static Shader shdr_mask = {0};
-static int loc_mask_tex = 0;
+static int loc_glyph_size = 0, loc_planes_num = 0, loc_planes = 0;
+static int loc_uv_rect = 0, loc_sdf = 0, loc_smoothing = 0;
+// Масштаб текущего прохода отрисовки, для сглаживания полей расстояний
+static float draw_zoom = 1.;
 static bool is_show_textures = true;
+// Пакетная отрисовка по текстурам вместо шейдера маски на каждый кусок
+static bool use_batch = true;
+static bool is_show_meshes = false;
+static struct RenderBatch batch = {0};
+static struct GlyphCache glyphs = {0};
+// Глифы полями расстояний, применяется перезапуском стадии
+static bool use_sdf = false;
+static bool use_sdf_dirty = false;
+// Запись действий, если задан --record. Файл открывается первым _init() и
+// живет до splitter_shutdown(), каждый сброс сцены пишет в нем новую сессию.
+static struct ReplayRecorder recorder = {0};
+static bool record_opened = false;
+// Выбор глифа по правой кнопке, зерно пишется в журнал
+static uint64_t rng = 1;
+// Последний загруженный снимок, с него же начинается сброс. Пусто - сцена
+// по умолчанию.
+static char snapshot_path[256] = {0};
+static bool snapshot_pending = false;
+// Запись снимка в следующем кадре, пусто - не нужна
+static char snapshot_save_path[256] = {0};
 
 static Texture2D tex_example = {0};
 
-#define GRABBABLE_MASK_BIT (1<<31)
-static cpShapeFilter GRAB_FILTER = {
-    CP_NO_GROUP, GRABBABLE_MASK_BIT, GRABBABLE_MASK_BIT
+// Запеченные куски, отрисованные в текстуру один раз на каждое изменение
+// статического слоя ядра.
+struct StaticLayer {
+    RenderTexture2D tex;
+    // Область мира, которую покрывает текстура
+    Rectangle       bounds;
+    uint64_t        version;
+    // Слишком большая область, куски рисуются пакетом каждый кадр
+    bool            direct;
 };
-//static cpShapeFilter NOT_GRABBABLE_FILTER = {
-    //CP_NO_GROUP, ~GRABBABLE_MASK_BIT, ~GRABBABLE_MASK_BIT
-//};
-
-#define DENSITY (1.0/10000.0)
-#define MAX_ENTITIES    256
-
-typedef struct Stage_Splitter {
-    Stage   parent;
-    cpSpace *space;
-    de_ecs  *r;
-    de_entity polygons[MAX_ENTITIES];
-    int       polygon_num;
-} Stage_Splitter;
 
-struct SliceContext {
-    cpVect a, b;
-    cpSpace *space;
+#define STATIC_LAYER_MAX_SIZE   4096
+
+static struct StaticLayer layer = {0};
+static bool bake_enabled = false;
+// Потоки для геометрии разрезов, применяются в splitter_update()
+static int slice_threads = 0;
+static bool slice_threads_dirty = false;
+// Потоки решателя физики, см. core_set_step_threads()
+static int step_threads = 1;
+static bool step_threads_dirty = false;
+
+// Копируется в ядро каждый кадр, меняется из консоли
+static struct FragmentBudget budget = {
+    .max_fragments = 512,
+    .policy = EVICT_SMALLEST,
 };
 
-struct Component_Body {
-    cpBody  *b;
-    //cpShape *shape;
+// Широкая фаза, копируется в ядро каждый кадр
+static struct BroadphaseOpts broadphase = {
+    .type = BROADPHASE_BBTREE,
 };
 
+// Площадь, ниже которой кусок становится частицей
+static cpFloat particle_min_area = 400.;
+
+typedef struct Stage_Splitter {
+    Stage           parent;
+    SplitterCore    core;
+} Stage_Splitter;
+
+// Положение на глифе и маска куска хранятся в comp_mask ядра.
 struct Component_Textured {
-    RenderTexture2D tex, mask;
-    cpTransform     tr;
+    struct GlyphTexture *glyph;
 };
 
 static void _init(Stage_Splitter *st);
 static void _shutdown(Stage_Splitter *st);
+static void static_layer_shutdown(void);
 static void on_destroy_textured(void *payload, de_entity e);
-static void slice(cpSpace *space, cpVect from, cpVect to);
-
-static de_cp_type comp_body = {
-    .cp_id = 1,
-    .cp_sizeof = sizeof(struct Component_Body),
-    .name = "body",
-};
 
 static de_cp_type comp_textured = {
     .cp_id = 2,
@@ -91,69 +141,6 @@ static de_cp_type comp_textured = {
     .on_destroy = on_destroy_textured,
 };
 
-static inline void *entt2ptr(de_entity e) {
-    return (void*)(uint64_t)e;
-}
-
-static inline de_entity ptr2entt(void *p) {
-    return (uint32_t)(ptrdiff_t)p;
-}
-
-static void create_poly(
-    de_entity e,
-    cpSpace *space, de_ecs *r, 
-    cpVect *verts, int vertsnum, 
-    cpTransform transform
-    //cpVect *centroid
-) {
-    assert(space);
-    assert(verts);
-    assert(r);
-    assert(de_valid(r, e));
-    struct Component_Body *b = de_emplace(r, e, comp_body);
-
-    cpFloat mass = cpAreaForPoly(vertsnum, verts, 0.0f) * DENSITY;
-    trace("create_poly: mass %f\n", mass);
-    cpVect centroid = cpCentroidForPoly(vertsnum, verts);
-    cpFloat moment = cpMomentForPoly(mass, vertsnum, verts, centroid, 0.0f);
-
-    b->b = cpBodyNew(mass, moment);
-    b->b->userData = entt2ptr(e);
-    cpShape *shape = cpPolyShapeNew(b->b, vertsnum, verts, transform, 0.);
-    //b->shape = shape;
-    cpSpaceAddBody(space, b->b);
-    cpSpaceAddShape(space, shape);
-}
-
-static void create_circle(
-    de_entity e, cpSpace *space, de_ecs *r, cpVect center, float radius
-) {
-    assert(space);
-    assert(r);
-    /*const int vertsnum = sizeof(verts) / sizeof(verts[0]);*/
-    /*create_poly(e, space, r, verts, vertsnum, cpTransformIdentity);*/
-    /*struct Component_Body *b = de_get(r, e, comp_body);*/
-    /*cpBodySetPosition(b->b, center);*/
-}
-
-static void create_box(
-    de_entity e, cpSpace *space, de_ecs *r, cpVect center, cpVect wh
-) {
-    assert(space);
-    assert(r);
-    float w = wh.x, h = wh.y;
-    cpVect verts[4] = {
-        { -w / 2., h / 2.},
-        { -w / 2., -h / 2.},
-        { w / 2., -h / 2.},
-        { w / 2., h / 2.},
-    };
-    const int vertsnum = sizeof(verts) / sizeof(verts[0]);
-    create_poly(e, space, r, verts, vertsnum, cpTransformIdentity);
-    struct Component_Body *b = de_get(r, e, comp_body);
-    cpBodySetPosition(b->b, center);
-}
-
 /*
 static void iter_shape_contor(cpBody *body, cpShape *shape, void *data) {
     Vector2 tri_strip[250] = {0};
@@ -179,404 +166,363 @@ static void iter_shape_contor(cpBody *body, cpShape *shape, void *data) {
 
     DrawTriangleStrip(tri_strip, j - 1, GREEN);
 
-    trace("iter_shape_contour: ");
-    for (int i = 0; i < num; i++) {
-        trace("%d ", tri_strip[i]);
-    }
-    trace("\n");
+    for (int i = 0; i < num; i++)
+        LOG_DEBUG(
+            "iter_shape_contour: %f %f\n", tri_strip[i].x, tri_strip[i].y
+        );
 
     cpBB bb = cpShapeGetBB(shape);
     bb_draw(bb_world2local(body, bb), BLUE);
-    trace("iter_shape_contour: %s\n", bb_tostr(bb));
+    LOG_DEBUG("iter_shape_contour: %s\n", bb_tostr(bb));
 }
 */
 
-static void iter_shape_contour(cpBody *body, cpShape *shape, void *data) {
-    Vector2 tri_strip[250] = {0};
-    int num = cpPolyShapeGetCount(shape);
-
-    assert(num < (sizeof(tri_strip) / sizeof(Vector2)));
-    if (num >= (sizeof(tri_strip) / sizeof(Vector2)))
+// CPU маска куска в toasts/, только в отладочном режиме dump_masks().
+// Кадр только переводит вершины в пиксели маски, растеризация и запись
+// в потоке dump.
+static void dump_mask(de_ecs *r, de_entity e) {
+    struct Component_Mask *m = de_try_get(r, e, comp_mask);
+    struct Component_Mesh *mesh = de_try_get(r, e, comp_mesh);
+    if (!m || !mesh || !mesh->verts_num)
         return;
 
-    int j = 0, i = 1;
-
-    while (i < num) {
-        tri_strip[j++] = from_Vect(cpPolyShapeGetVert(shape, 0));
-        tri_strip[j++] = from_Vect(cpPolyShapeGetVert(shape, i));
-        if (i + 1 < num)
-            tri_strip[j++] = from_Vect(cpPolyShapeGetVert(shape, i + 1));
-        i++;
-    }
-
-    Camera2D _cam = {0};
-    Rectangle bb_rect = from_bb(cpShapeGetBB(shape));
-    _cam.zoom = 1.;
-    _cam.offset = (Vector2) { bb_rect.width / 2., bb_rect.height / 2. };
-    BeginMode2D(_cam);
-
-    DrawTriangleStrip(tri_strip, j - 1, random_raylib_color());
-
-    trace("iter_shape_contour: %p\n", body);
-    trace("iter_shape_contour: shapeList %p\n", body->shapeList);
-    for (i = 0; i < num; i++) {
-        trace("%d ", tri_strip[i]);
+    int w = m->size.x, h = m->size.y;
+    int num = mesh->verts_num;
+    cpVect verts[num];
+    cpTransform body2glyph = cpTransformInverse(m->tr);
+    for (int i = 0; i < num; i++) {
+        cpVect g = cpTransformPoint(body2glyph, mesh->verts[i]);
+        verts[i] = cpv(g.x + w / 2., g.y + h / 2.);
     }
-    trace("\n");
 
-    cpBB bb = cpShapeGetBB(shape);
-    bb_draw(bb_world2local(body, bb), BLUE);
-    EndMode2D();
-    trace("iter_shape_contour: bb %s\n", bb_tostr(bb));
-    trace("iter_shape_contour: rect %s\n", rect2str(from_bb(bb)));
+    char fname[128] = {0};
+    snprintf(fname, sizeof(fname), "toasts/%u.png", (unsigned)e);
+    dump_push_mask(verts, num, w, h, fname);
 }
 
-/*
-Как рисовать контур в целевую текстуру - рисовать контуры всех форм или только
-одной? Контуры могут быть далеко разнесены в пределах тела. Использовать-ли
-масштабирование к размеру целевой текстуры?
-*/
-static void render_contour(RenderTexture2D *target, cpBody *b) {
-    assert(b);
-    assert(target);
-
-    trace(
-        "render_contour: %dx%d\n",
-        target->texture.width,
-        target->texture.height
-    );
-
-    BeginTextureMode(*target);
-
-    //BeginMode2D(_cam);
-    ClearBackground(WHITE);
+static void update_mask(
+    SplitterCore *core, de_entity e_new, de_entity e_old, cpBody *body
+) {
+    de_ecs *r = core->r;
+    struct Component_Textured *t = de_try_get(r, e_old, comp_textured);
+    if (!t) {
+        LOG_WARN("update_mask: t == NULL\n");
+        return;
+    }
+    PROF_BEGIN(PROF_UPDATE_MASK);
+    // de_emplace может переместить хранилище компонента
+    struct GlyphTexture *glyph = t->glyph;
 
-    cpBodyEachShape(b, iter_shape_contour, NULL);
-    //EndMode2D();
-    EndTextureMode();
+    struct Component_Textured *t_new = de_emplace(r, e_new, comp_textured);
+    t_new->glyph = glyph_ref(glyph);
 
-#if 1
-    Image img = LoadImageFromTexture(target->texture);
-    char fname[128] = {0};
-    sprintf(fname, "toasts/%p.png", b);
-    ExportImage(img, fname);
-    UnloadImage(img);
-#endif
+    if (dump_is_enabled())
+        dump_mask(r, e_new);
+    PROF_END(PROF_UPDATE_MASK);
 }
 
-struct ShapeCopyCtx {
-    float friction;
-};
+de_entity create_char(
+    SplitterCore *core, const char *input, Vector2 abs_pos
+) {
+    assert(core);
+    assert(input);
+    de_entity e = de_null;
 
-static void iter_shape_copy(cpBody *body, cpShape *shape, void *data) {
-    struct ShapeCopyCtx *ctx = data;
-    cpShapeSetFriction(shape, ctx->friction);
-}
+    struct GlyphTexture *glyph = glyph_cache_get(&glyphs, input, fnt.baseSize);
+    cpVect sz = { glyph->size.x, glyph->size.y };
+    e = core_create_box(core, from_Vector2(abs_pos), sz);
 
-static de_entity ClipPoly(cpSpace *space, cpShape *shape, cpVect n, cpFloat dist) {
-    cpBody *body = cpShapeGetBody(shape);
-    
-    int count = cpPolyShapeGetCount(shape);
-    int clippedCount = 0;
-    
-    cpVect clipped[count + 1];
-    
-    for(int i=0, j=count-1; i<count; j=i, i++){
-        cpVect a = cpBodyLocalToWorld(body, cpPolyShapeGetVert(shape, j));
-        cpFloat a_dist = cpvdot(a, n) - dist;
-        
-        if(a_dist < 0.0){
-            clipped[clippedCount] = a;
-            clippedCount++;
-        }
-        
-        cpVect b = cpBodyLocalToWorld(body, cpPolyShapeGetVert(shape, i));
-        cpFloat b_dist = cpvdot(b, n) - dist;
-        
-        if(a_dist*b_dist < 0.0f){
-            cpFloat t = cpfabs(a_dist)/(cpfabs(a_dist) + cpfabs(b_dist));
-            
-            clipped[clippedCount] = cpvlerp(a, b, t);
-            clippedCount++;
-        }
-    }
-    
+    struct Component_Textured *t = de_emplace(core->r, e, comp_textured);
+    t->glyph = glyph_ref(glyph);
 
-    cpVect centroid = cpCentroidForPoly(clippedCount, clipped);
-    de_ecs *r = ((Stage_Splitter*)space->userData)->r;
-    cpTransform transform = cpTransformTranslate(cpvneg(centroid));
-    de_entity e = de_create(r);
-    create_poly(e, space, r, clipped, clippedCount, transform);
-    struct Component_Body* b = de_get(r, e, comp_body);
-    assert(b);
-
-    cpBodySetPosition(b->b, centroid);
-    cpBodySetVelocity(b->b, cpBodyGetVelocityAtWorldPoint(body, centroid));
-    cpBodySetAngularVelocity(b->b, cpBodyGetAngularVelocity(body));
-   
-    // Copy whatever properties you have set on the original shape that are important
-    struct ShapeCopyCtx ctx_copy = {
-        .friction = cpShapeGetFriction(shape),
-    };
-    cpBodyEachShape(b->b, iter_shape_copy, &ctx_copy);
+    if (dump_is_enabled())
+        dump_mask(core->r, e);
     return e;
 }
 
-static RenderTexture2D clone_render_texture(RenderTexture2D src) {
-    RenderTexture2D dst = LoadRenderTexture(
-        src.texture.width, src.texture.height
+// Глиф от игрока или сцены, попадает в журнал
+static de_entity spawn_char(
+    SplitterCore *core, const char *input, Vector2 abs_pos
+) {
+    de_entity e = create_char(core, input, abs_pos);
+    struct Component_Mask *m = de_try_get(core->r, e, comp_mask);
+    assert(m);
+    struct ReplaySpawn spawn = {
+        .center = from_Vector2(abs_pos),
+        .wh = m->size,
+        .ch = input[0],
+    };
+    replay_record(
+        &recorder, core->clock.steps, REPLAY_SPAWN, &spawn, sizeof(spawn)
     );
-    assert(dst.id != 0);
-    Camera2D cam_local = {0};
-    cam_local.zoom = 1.;
+    return e;
+}
 
-    BeginMode2D(cam_local);
-    BeginTextureMode(dst);
-    DrawTexture(src.texture, 0, 0, WHITE);
-    EndMode2D();
-    return dst;
+static void diagonal_slice(SplitterCore *core, de_entity e) {
+    replay_record(&recorder, core->clock.steps, REPLAY_DIAGONAL, NULL, 0);
+    core_diagonal_slice(core, e);
 }
 
-static void update_mask(
-    de_ecs *r, de_entity e_new, de_entity e_old, cpBody *body
-) {
-    struct Component_Textured *t = de_try_get(r, e_old, comp_textured);
-    if (!t) {
-        trace("SliceShapePostStep: t == NULL\n");
-        return;
-    }
+static void xxx_draw_slice(void *udata) {
+    cpVect *line = udata;
+    DrawLineV(from_Vect(line[0]), from_Vect(line[1]), BLUE);
+}
 
-    struct Component_Textured *t_new = de_emplace(r, e_new, comp_textured);
-    t_new->tex = clone_render_texture(t->tex);
-    t_new->mask = clone_render_texture(t->mask);
-    BeginTextureMode(t_new->mask);
-
-    /*default_cam.offset = from_Vect(body->p);*/
-
-    Camera2D _cam = {0};
-    //_cam.zoom = 0.8;
-    cam.zoom = 1.;
-    BeginMode2D(_cam);
-    render_contour(&t_new->mask, body);
-    /*DrawTexture(t->mask.texture, 0, 0, YELLOW);*/
-    /*DrawCircle(1, 1, 1000, YELLOW);*/
-    EndMode2D();
-    EndTextureMode();
+static void on_slice(SplitterCore *core, cpVect from, cpVect to) {
+    cpVect line[2] = { from, to };
+    dev_draw_push(xxx_draw_slice, line, sizeof(line));
 }
 
-static void
-SliceShapePostStep(cpSpace *space, cpShape *shape, struct SliceContext *context)
-{
-    de_ecs *r = ((Stage_Splitter*)space->userData)->r;
-    cpVect a = context->a;
-    cpVect b = context->b;
-    
-    // Clipping plane normal and distance.
-    cpVect n = cpvnormalize(cpvperp(cpvsub(b, a)));
-    cpFloat dist = cpvdot(a, n);
-    
-    de_entity e_new1 = de_null, e_new2 = de_null;
+// Пустой мир с текущими настройками
+static void core_setup(Stage_Splitter *st) {
+    memset(&cam, 0, sizeof(cam));
+    cam.zoom = 0.6;
+    cam.offset = (Vector2) {
+        .x = 1733,
+        .y = 722,
+    };
 
-    cpBody *body = cpShapeGetBody(shape);
-    e_new1 = ClipPoly(space, shape, n, dist);
+    core_init(&st->core);
+    st->core.budget = budget;
+    st->core.broadphase = broadphase;
+    st->core.lod.min_area = particle_min_area;
+    st->core.bake.enabled = bake_enabled;
+    core_set_slice_threads(&st->core, slice_threads);
+    slice_threads_dirty = false;
+    core_set_step_threads(&st->core, step_threads);
+    step_threads_dirty = false;
+    st->core.hooks = (struct SplitterCoreHooks) {
+        .on_slice = on_slice,
+        .on_fragment = update_mask,
+    };
+    st->core.udata = st;
+}
 
-    de_entity e_old = ptr2entt(body->userData);
-    update_mask(r, e_new1, e_old, body);
+static void _init(Stage_Splitter *st) {
+    core_setup(st);
 
-    e_new2 = ClipPoly(space, shape, cpvneg(n), -dist);
-    update_mask(r, e_new2, e_old, body);
-    
-    cpSpaceRemoveShape(space, shape);
-    cpSpaceRemoveBody(space, body);
-    cpShapeFree(shape);
-
-    if (body) {
-        de_entity e = ptr2entt(body->userData);
-        if (de_valid(r, e)) {
-            trace("SliceShapePostStep: de_destroy %lu\n", e);
-            cpBodyFree(body);
-            de_destroy(r, e);
-        }
+    // Файл журнала открывается один раз за процесс, каждый сброс сцены
+    // начинает в нем новую сессию
+    struct SplitterCtx *ctx = st->parent.data;
+    if (ctx && ctx->record_path && !record_opened) {
+        record_opened = true;
+        replay_record_open(&recorder, ctx->record_path, rng, &st->core.clock);
+    }
+    if (recorder.f) {
+        replay_record_resume(&recorder);
+        cpVect g = cpSpaceGetGravity(st->core.space);
+        replay_record_opts(&recorder, &st->core);
+        replay_record(&recorder, 0, REPLAY_GRAVITY, &g, sizeof(g));
     }
 
-    free(context);
-}
+    core_create_floor_and_walls(&st->core);
+    replay_record(&recorder, 0, REPLAY_WALLS, NULL, 0);
 
-static void
-SliceQuery(
-    cpShape *shape, cpVect point, cpVect normal, cpFloat alpha, 
-    struct SliceContext *context
-)
-{
-    cpVect a = context->a;
-    cpVect b = context->b;
+    de_entity e = de_null;
 
-    /*
-    trace(
-        "SliceQuery: from %s to %s\n",
-        context->a,
-        context->b
-    );
-    */
+    e = spawn_char(&st->core, "A", (Vector2) { 200, 100 });
+    diagonal_slice(&st->core, e);
 
-    if (shape->klass->type != CP_POLY_SHAPE) {
-        return;
-    }
+    e = spawn_char(&st->core, "H", (Vector2) { 1200, 0 });
+    diagonal_slice(&st->core, e);
 
-    // Check that the slice was complete by checking that the endpoints aren't in the sliced shape.
-    if(cpShapePointQuery(shape, a, NULL) > 0.0f && cpShapePointQuery(shape, b, NULL) > 0.0f){
-        // Can't modify the space during a query.
-        // Must make a post-step callback to do the actual slicing.
-        cpSpaceAddPostStepCallback(
-            context->space, (cpPostStepFunc)SliceShapePostStep, shape, context
-        );
-    }
+    e = spawn_char(&st->core, "J", (Vector2) { 200, 600, });
+    diagonal_slice(&st->core, e);
 }
 
-static void create_floor_and_walls(Stage_Splitter *st) {
-    const float radius = 1.;
-    cpVect a = { 100, 1000 }, b = { 1920 - 100, 1000 };
-    float wall_height = 100.;
-    //float mass = 100;
-    //float moment = cpMomentForSegment(mass, a, b, radius);
-    cpBody *body = cpBodyNewStatic();
-    cpShape *segment = cpSegmentShapeNew(body, a, b, radius);
-    cpSpaceAddBody(st->space, body);
-    cpBodyAddShape(body, segment);
-    cpSpaceAddShape(st->space, segment);
+static const char *snapshot_tag(SplitterCore *core, de_entity e, void *udata) {
+    struct Component_Textured *t = de_try_get(core->r, e, comp_textured);
+    return t ? glyph_key(t->glyph) : NULL;
+}
 
-    body = cpBodyNewStatic();
-    segment = cpSegmentShapeNew(
-        body, a, (cpVect) { a.x, a.y - wall_height}, radius
-    );
-    cpSpaceAddBody(st->space, body);
-    cpBodyAddShape(body, segment);
-    cpSpaceAddShape(st->space, segment);
+static void snapshot_restore(
+    SplitterCore *core, de_entity e, const char *tag, void *udata
+) {
+    if (!tag)
+        return;
+    struct GlyphTexture *glyph = glyph_cache_get(&glyphs, tag, fnt.baseSize);
+    struct Component_Textured *t = de_emplace(core->r, e, comp_textured);
+    t->glyph = glyph_ref(glyph);
+}
 
-    body = cpBodyNewStatic();
-    segment = cpSegmentShapeNew(
-        body, b, (cpVect) { b.x, b.y - wall_height}, radius
-    );
-    cpSpaceAddBody(st->space, body);
-    cpBodyAddShape(body, segment);
-    cpSpaceAddShape(st->space, segment);
+// Мир из снимка вместо начальной сцены, журнал действий не пишется
+static bool _restore(Stage_Splitter *st, const char *path) {
+    core_setup(st);
+    if (recorder.f)
+        trace("_restore: scene from snapshot is not recorded\n");
+    core_create_floor_and_walls(&st->core);
+    bool ok = snapshot_load(&st->core, path, snapshot_restore, NULL);
+    use_gravity = !cpveql(cpSpaceGetGravity(st->core.space), cpvzero);
+    return ok;
 }
 
-de_entity push_entt(Stage_Splitter *st, de_entity e) {
-    assert(st);
-    if (st->polygon_num < MAX_ENTITIES)
-        st->polygons[st->polygon_num++] = e;
-    else {
-        trace("push_entt: entities limit reached\n");
-        exit(EXIT_FAILURE);
+// Снимок, если он был загружен, иначе начальная сцена
+static void _start(Stage_Splitter *st) {
+    if (snapshot_path[0]) {
+        if (_restore(st, snapshot_path))
+            return;
+        trace("_start: could not restore %s\n", snapshot_path);
+        snapshot_path[0] = 0;
+        _shutdown(st);
     }
-    return e;
+    _init(st);
 }
 
-RenderTexture2D bake_string(const char *input, int basesize) {
-    Vector2 measure = MeasureTextEx(fnt, input, basesize, 0.);
-    const float thick = 4.;
-    RenderTexture2D tex = LoadRenderTexture(measure.x, measure.y);
-    trace(
-        "bake_string: tex.width %d tex.height %d\n",
-        tex.texture.width,
-        tex.texture.height
-    );
-    BeginTextureMode(tex);
-    DrawTextEx(fnt, input, (Vector2) { 0, 0}, fnt.baseSize, 0., WHITE);
-    DrawRectangleLinesEx(
-        (Rectangle) { 
-            .x = 0, .y = 0, .width = measure.x, .height = measure.y,
-        }, 
-        thick, BLUE
-    );
-    EndTextureMode();
-    return tex;
+static void hk_show_textures(Hotkey *hk) {
+    trace("hk_show_textures:\n");
+    is_show_textures = !is_show_textures;
 }
 
-de_entity create_char(
-    cpSpace *space, de_ecs *r, const char *input, Vector2 abs_pos
-) {
-    assert(space);
-    assert(r);
-    assert(input);
-    de_entity e = de_null;
+static void hk_use_batch(Hotkey *hk) {
+    use_batch = !use_batch;
+    trace("hk_use_batch: %s\n", use_batch ? "true" : "false");
+}
 
-    e = de_create(r);
+#ifdef SPLITTER_PROFILE
+static void hk_prof_dump(Hotkey *hk) {
+    prof_dump_csv("splitter_prof.csv");
+}
+#endif
 
-    struct Component_Textured *t = de_emplace(r, e, comp_textured);
-    t->tr = cpTransformIdentity;
-    t->tex = bake_string(input, fnt.baseSize);
-    t->mask = LoadRenderTexture(t->tex.texture.width, t->tex.texture.height);
-    cpVect sz = { t->tex.texture.width, t->tex.texture.height };
+static void hk_show_meshes(Hotkey *hk) {
+    is_show_meshes = !is_show_meshes;
+}
 
-    create_box(e, space, r, from_Vector2(abs_pos), sz); 
-    struct Component_Body *b = de_try_get(r, e, comp_body);
-    assert(b);
+static void hk_remove_body(Hotkey *hk) {
+    trace("hk_remove_body:\n");
+}
 
-    render_contour(&t->mask, b->b);
-    return e;
+// Lua: dump_masks([enabled]) - без аргумента переключает режим.
+static int l_dump_masks(lua_State *lua) {
+    bool enabled = !dump_is_enabled();
+    if (lua_gettop(lua) >= 1)
+        enabled = lua_toboolean(lua, 1);
+    dump_enable(enabled);
+    trace("l_dump_masks: %s\n", enabled ? "true" : "false");
+    lua_pushboolean(lua, enabled);
+    return 1;
 }
 
-static void create_cp(Stage_Splitter *st) {
-    cpSpace *space = st->space = cpSpaceNew();
-    space->userData = st;
-    cpSpaceSetIterations(space, 30);
-    //cpSpaceSetGravity(space, cpv(0, -500));
-    cpSpaceSetSleepTimeThreshold(space, 0.5f);
-    cpSpaceSetCollisionSlop(space, 0.5f);
-    trace("splitter_init: space dumping %f\n", cpSpaceGetDamping(st->space));
-    cpSpaceSetDamping(st->space, 0.9);
-}
-
-static void diagonal_slice(cpSpace *space, de_ecs *r, de_entity e) {
-    struct Component_Body *b = de_try_get(r, e, comp_body);
-    assert(b);
-
-    cpShape *shape = b->b->shapeList;
-    assert(shape->next == NULL);
-    //trace("diagonal_slice: %p, %p\n", shape, shape->next);
-    Rectangle rect = from_bb(cpShapeGetBB(shape));
-    cpVect half_abit = {
-        .x = rect.width / 2. + 10.,
-        .y = rect.height / 2. + 10.,
-    };
-    cpSpaceStep(space, 1 / 60.);
-    slice(space, cpvsub(b->b->p, half_abit), cpvadd(b->b->p, half_abit));
-    //cpSpaceStep(space, 1 / 60.);
+// Lua: fragment_budget([max[, "smallest"|"oldest"]]) - 0 снимает ограничение.
+static int l_fragment_budget(lua_State *lua) {
+    if (lua_gettop(lua) >= 1)
+        budget.max_fragments = lua_tointeger(lua, 1);
+    if (lua_gettop(lua) >= 2) {
+        const char *policy = lua_tostring(lua, 2);
+        if (policy && !strcmp(policy, "oldest"))
+            budget.policy = EVICT_OLDEST;
+        else
+            budget.policy = EVICT_SMALLEST;
+    }
+    trace(
+        "l_fragment_budget: max %d, policy %s\n",
+        budget.max_fragments, evict_policy2str(budget.policy)
+    );
+    lua_pushinteger(lua, budget.max_fragments);
+    return 1;
 }
 
-static void _init(Stage_Splitter *st) {
-    memset(&cam, 0, sizeof(cam));
-    cam.zoom = 0.6;
-    cam.offset = (Vector2) {
-        .x = 1733,
-        .y = 722,
-    };
+// Lua: broadphase([type, [dim, count]]) - bbtree или hash, dim и count 0
+// подбираются по размерам кусков.
+static int l_broadphase(lua_State *lua) {
+    if (lua_gettop(lua) >= 1) {
+        const char *type = lua_tostring(lua, 1);
+        if (type && !strcmp(type, "hash"))
+            broadphase.type = BROADPHASE_HASH;
+        else
+            broadphase.type = BROADPHASE_BBTREE;
+        broadphase.dim = 0.;
+        broadphase.count = 0;
+    }
+    if (lua_gettop(lua) >= 2)
+        broadphase.dim = lua_tonumber(lua, 2);
+    if (lua_gettop(lua) >= 3)
+        broadphase.count = lua_tointeger(lua, 3);
+    trace(
+        "l_broadphase: %s, dim %f, count %d\n",
+        broadphase2str(broadphase.type), broadphase.dim, broadphase.count
+    );
+    lua_pushstring(lua, broadphase2str(broadphase.type));
+    return 1;
+}
 
-    st->r = de_ecs_make();
-    create_cp(st);
-    create_floor_and_walls(st);
+// Lua: bake_sleeping([enabled]) - без аргумента переключает режим.
+static int l_bake_sleeping(lua_State *lua) {
+    bake_enabled = !bake_enabled;
+    if (lua_gettop(lua) >= 1)
+        bake_enabled = lua_toboolean(lua, 1);
+    trace("l_bake_sleeping: %s\n", bake_enabled ? "true" : "false");
+    lua_pushboolean(lua, bake_enabled);
+    return 1;
+}
 
-    de_entity e = de_null;
+// Lua: slice_threads([num]) - 0 режет в главном потоке.
+static int l_slice_threads(lua_State *lua) {
+    if (lua_gettop(lua) >= 1) {
+        int num = lua_tointeger(lua, 1);
+        slice_threads = num < 0 ? 0 : num;
+        slice_threads_dirty = true;
+    }
+    trace("l_slice_threads: %d\n", slice_threads);
+    lua_pushinteger(lua, slice_threads);
+    return 1;
+}
 
-    e = push_entt(st, create_char(st->space, st->r, "A", (Vector2) { 200, 100 }));
-    diagonal_slice(st->space, st->r, e);
+// Lua: physics_threads([num]) - 1 без потоков, 0 - по числу ядер.
+static int l_physics_threads(lua_State *lua) {
+    if (lua_gettop(lua) >= 1) {
+        int num = lua_tointeger(lua, 1);
+        step_threads = num < 0 ? 0 : num;
+        step_threads_dirty = true;
+    }
+    trace("l_physics_threads: %d\n", step_threads);
+    lua_pushinteger(lua, step_threads);
+    return 1;
+}
 
-    e = push_entt(st, create_char(st->space, st->r, "H", (Vector2) { 1200, 0 }));
-    diagonal_slice(st->space, st->r, e);
+// Lua: sdf_glyphs([enabled]) - переключение пересоздает сцену.
+static int l_sdf_glyphs(lua_State *lua) {
+    if (lua_gettop(lua) >= 1) {
+        bool enabled = lua_toboolean(lua, 1);
+        use_sdf_dirty = enabled != use_sdf;
+        use_sdf = enabled;
+    }
+    trace("l_sdf_glyphs: %s\n", use_sdf ? "true" : "false");
+    lua_pushboolean(lua, use_sdf);
+    return 1;
+}
 
-    e = push_entt(st, create_char(st->space, st->r, "J", (Vector2) { 200, 600, }));
-    diagonal_slice(st->space, st->r, e);
+// Lua: snapshot_save(path) - мир в файл для snapshot_load() и бенчмарка,
+// пишется в следующем кадре.
+static int l_snapshot_save(lua_State *lua) {
+    const char *path = lua_tostring(lua, 1);
+    if (path)
+        strncpy(snapshot_save_path, path, sizeof(snapshot_save_path) - 1);
+    trace("l_snapshot_save: %s\n", snapshot_save_path);
+    lua_pushboolean(lua, path != NULL);
+    return 1;
 }
 
-static void hk_show_textures(Hotkey *hk) {
-    trace("hk_show_textures:\n");
-    is_show_textures = !is_show_textures;
+// Lua: snapshot_load(path) - применяется в следующем кадре, сброс тоже
+// возвращает к этому снимку.
+static int l_snapshot_load(lua_State *lua) {
+    const char *path = lua_tostring(lua, 1);
+    if (path) {
+        strncpy(snapshot_path, path, sizeof(snapshot_path) - 1);
+        snapshot_pending = true;
+    }
+    trace("l_snapshot_load: %s\n", snapshot_path);
+    lua_pushstring(lua, snapshot_path);
+    return 1;
 }
 
-static void hk_remove_body(Hotkey *hk) {
-    trace("hk_remove_body:\n");
+// Lua: particle_lod([min_area]) - 0 отключает превращение кусков в частицы.
+static int l_particle_lod(lua_State *lua) {
+    if (lua_gettop(lua) >= 1)
+        particle_min_area = lua_tonumber(lua, 1);
+    trace("l_particle_lod: min_area %f\n", particle_min_area);
+    lua_pushnumber(lua, particle_min_area);
+    return 1;
 }
 
 static void splitter_init(Stage_Splitter *st) {
@@ -584,12 +530,75 @@ static void splitter_init(Stage_Splitter *st) {
 
     tex_example = LoadTexture("assets/uv.png");
 
-    fnt = load_font_unicode("assets/fonts/VictorMono-Medium.ttf", 455);
+    fnt_from_atlas = atlas_load(
+        &fnt, SPLITTER_FONT_TTF, SPLITTER_FONT_ATLAS, SPLITTER_FONT_SIZE,
+        SPLITTER_FONT_CHARS
+    );
+    if (!fnt_from_atlas) {
+        trace(
+            "splitter_init: no font atlas, rasterizing %s\n",
+            SPLITTER_FONT_TTF
+        );
+        fnt = load_font_unicode(SPLITTER_FONT_TTF, SPLITTER_FONT_SIZE);
+    }
     shdr_mask = LoadShader(NULL, "assets/vertex/100_fragment_stencil.glsl");
-    loc_mask_tex = GetShaderLocation(shdr_mask, "mask_texture");
+    loc_glyph_size = GetShaderLocation(shdr_mask, "glyph_size");
+    loc_planes_num = GetShaderLocation(shdr_mask, "planes_num");
+    loc_planes = GetShaderLocation(shdr_mask, "planes");
+    loc_uv_rect = GetShaderLocation(shdr_mask, "uv_rect");
+    loc_sdf = GetShaderLocation(shdr_mask, "sdf");
+    loc_smoothing = GetShaderLocation(shdr_mask, "smoothing");
+
+    dump_init(64);
+    batch_init(&batch);
+    glyph_cache_init(&glyphs, fnt, fnt.baseSize, use_sdf);
+    sc_register_function(
+        l_dump_masks, "dump_masks",
+        "Сохранять маски кусков в toasts/ в фоновом потоке"
+    );
+    sc_register_function(
+        l_fragment_budget, "fragment_budget",
+        "Наибольшее число кусков и какие удалять: smallest или oldest"
+    );
+    sc_register_function(
+        l_particle_lod, "particle_lod",
+        "Площадь, ниже которой кусок становится частицей без тела"
+    );
+    sc_register_function(
+        l_bake_sleeping, "bake_sleeping",
+        "Переносить уснувшие куски в статический слой"
+    );
+    sc_register_function(
+        l_slice_threads, "slice_threads",
+        "Число потоков для геометрии разрезов, 0 - главный поток"
+    );
+    sc_register_function(
+        l_broadphase, "broadphase",
+        "Широкая фаза: bbtree или hash, размер ячейки и число ячеек"
+    );
+    sc_register_function(
+        l_physics_threads, "physics_threads",
+        "Число потоков решателя физики, 1 - без потоков, 0 - по числу ядер"
+    );
+    sc_register_function(
+        l_snapshot_save, "snapshot_save",
+        "Сохранить мир в файл снимка"
+    );
+    sc_register_function(
+        l_snapshot_load, "snapshot_load",
+        "Загрузить мир из файла снимка, сброс возвращает к нему"
+    );
+    sc_register_function(
+        l_sdf_glyphs, "sdf_glyphs",
+        "Глифы полями расстояний со знаком, сцена пересоздается"
+    );
 
     assert(st->parent.data);
     struct SplitterCtx *ctx = st->parent.data;
+    if (ctx->step_threads >= 0)
+        step_threads = ctx->step_threads;
+    if (ctx->seed)
+        rng = ctx->seed;
 
     hotkey_register(ctx->hk_store, (Hotkey) {
         .name = "remove",
@@ -617,135 +626,400 @@ static void splitter_init(Stage_Splitter *st) {
         },
     });
 
+    hotkey_register(ctx->hk_store, (Hotkey) {
+        .name = "use_batch",
+        .description = "Пакетная отрисовка кусков или шейдер маски на каждый",
+        .func = hk_use_batch,
+        .data = NULL,
+        .enabled = true,
+        .groups = HOTKEY_GROUP_SPLITTER,
+        .combo = {
+            .mode = HM_MODE_ISKEYPRESSED,
+            .key = KEY_B,
+        },
+    });
+
+    hotkey_register(ctx->hk_store, (Hotkey) {
+        .name = "show_meshes",
+        .description = "Показать триангуляцию кусков",
+        .func = hk_show_meshes,
+        .data = NULL,
+        .enabled = true,
+        .groups = HOTKEY_GROUP_SPLITTER,
+        .combo = {
+            .mode = HM_MODE_ISKEYPRESSED,
+            .key = KEY_M,
+        },
+    });
+
+#ifdef SPLITTER_PROFILE
+    hotkey_register(ctx->hk_store, (Hotkey) {
+        .name = "prof_dump",
+        .description = "Записать время фаз кадров в splitter_prof.csv",
+        .func = hk_prof_dump,
+        .data = NULL,
+        .enabled = true,
+        .groups = HOTKEY_GROUP_SPLITTER,
+        .combo = {
+            .mode = HM_MODE_ISKEYPRESSED,
+            .key = KEY_F10,
+        },
+    });
+#endif
+
     _init(st);
 }
 
-static void iter_shape_free(cpBody *body, cpShape *shape, void *data) {
-    cpSpace *space = data;
-    cpSpaceRemoveShape(space, shape);
-    cpShapeFree(shape);
+static void _shutdown(Stage_Splitter *st) {
+    replay_record_reset(&recorder, st->core.clock.steps);
+    core_shutdown(&st->core);
+    static_layer_shutdown();
+}
+
+void splitter_shutdown(Stage_Splitter *st) {
+    trace("splitter_shutdown:\n");
+
+    replay_record_close(&recorder, st->core.clock.steps);
+    _shutdown(st);
+    dump_shutdown();
+    batch_shutdown(&batch);
+    glyph_cache_shutdown(&glyphs);
+
+    if (fnt_from_atlas)
+        atlas_unload(&fnt);
+    else
+        UnloadFont(fnt);
+    UnloadShader(shdr_mask);
+    UnloadTexture(tex_example);
+}
+
+// Полширины перехода в единицах поля: половина экранного пикселя
+static void set_sdf_uniforms(void) {
+    int sdf = glyphs.sdf;
+    float smoothing = 0.25 / (draw_zoom * GLYPH_SDF_SPREAD * GLYPH_SDF_SCALE);
+    SetShaderValue(shdr_mask, loc_sdf, &sdf, SHADER_UNIFORM_INT);
+    SetShaderValue(shdr_mask, loc_smoothing, &smoothing, SHADER_UNIFORM_FLOAT);
 }
 
-static void free_bodies(Stage_Splitter *st) {
-    de_view_single view = de_create_view_single(st->r, comp_body);
-    while (de_view_single_valid(&view)) {
-        struct Component_Body *b = de_view_single_get(&view);
-        //cpBodyEachShape(b->b, iter_shape_free, st->space);
-        //cpSpaceRemoveBody(st->space, b->b);
-        de_view_single_next(&view);
+// Пакет обрезан по геометрии и шейдер маски не нужен, кроме режима sdf
+static void batch_flush(void) {
+    if (!glyphs.sdf) {
+        batch_draw(&batch, WHITE);
+        return;
     }
+    int planes_num = 0;
+    set_sdf_uniforms();
+    SetShaderValue(shdr_mask, loc_planes_num, &planes_num, SHADER_UNIFORM_INT);
+    BeginShaderMode(shdr_mask);
+    batch_draw(&batch, WHITE);
+    EndShaderMode();
 }
 
-static void _shutdown(Stage_Splitter *st) {
-    free_bodies(st);
-    if (st->space) {
-        space_shutdown((struct SpaceShutdownCtx) {
-            .space = st->space,
-            .free_bodies = true,
-            .free_shapes = true,
-            .free_constraints = true,
-        });
-        cpSpaceFree(st->space);
-        st->space = NULL;
+static void set_mask_uniforms(
+    const struct Component_Mask *m, const struct GlyphTexture *glyph
+) {
+    set_sdf_uniforms();
+    float glyph_size[2] = { m->size.x, m->size.y };
+    float uv_rect[4] = {
+        glyph->uv.x, glyph->uv.y, glyph->uv.width, glyph->uv.height,
+    };
+    float planes[MAX_CLIP_PLANES * 3];
+    for (int i = 0; i < m->planes.num; i++) {
+        planes[i * 3 + 0] = m->planes.n[i].x;
+        planes[i * 3 + 1] = m->planes.n[i].y;
+        planes[i * 3 + 2] = m->planes.dist[i];
+    }
+    SetShaderValue(shdr_mask, loc_glyph_size, glyph_size, SHADER_UNIFORM_VEC2);
+    SetShaderValue(shdr_mask, loc_uv_rect, uv_rect, SHADER_UNIFORM_VEC4);
+    SetShaderValue(
+        shdr_mask, loc_planes_num, &m->planes.num, SHADER_UNIFORM_INT
+    );
+    if (m->planes.num)
+        SetShaderValueV(
+            shdr_mask, loc_planes, planes, SHADER_UNIFORM_VEC3, m->planes.num
+        );
+}
+
+// Центр масс в том же интерполированном положении, что и само тело
+static void draw_body_center(const struct Component_Body *b, double alpha) {
+    cpVect p = cpTransformPoint(core_body_transform(b, alpha), b->b->cog);
+    DrawCircle(p.x, p.y, 10, BLUE);
+}
+
+static void draw_chars_batched(de_ecs *r, double alpha) {
+    de_view view = de_create_view(
+        r, 4, (de_cp_type[4]) { comp_body, comp_textured, comp_mask, comp_mesh }
+    );
+    while (de_view_valid(&view)) {
+        struct Component_Body *b = de_view_get(&view, comp_body);
+        struct Component_Textured *t = de_view_get(&view, comp_textured);
+        struct Component_Mask *m = de_view_get(&view, comp_mask);
+        struct Component_Mesh *mesh = de_view_get(&view, comp_mesh);
+        batch_push(
+            &batch, t->glyph->tex, t->glyph->uv,
+            core_body_transform(b, alpha), m, mesh
+        );
+        de_view_next(&view);
     }
-    if (st->r) {
-        de_ecs_destroy(st->r);
-        st->r = NULL;
+    batch_flush();
+
+    view = de_create_view(r, 1, (de_cp_type[1]) { comp_body });
+    while (de_view_valid(&view)) {
+        struct Component_Body *b = de_view_get(&view, comp_body);
+        draw_body_center(b, alpha);
+        de_view_next(&view);
     }
 }
 
-void splitter_shutdown(Stage_Splitter *st) {
-    trace("splitter_shutdown:\n");
+static int push_baked(de_ecs *r) {
+    int num = 0;
+    de_view v = de_create_view(
+        r, 4, (de_cp_type[4]) { comp_baked, comp_textured, comp_mask, comp_mesh }
+    );
+    while (de_view_valid(&v)) {
+        struct Component_Baked *bk = de_view_get(&v, comp_baked);
+        struct Component_Textured *t = de_view_get(&v, comp_textured);
+        struct Component_Mask *m = de_view_get(&v, comp_mask);
+        struct Component_Mesh *mesh = de_view_get(&v, comp_mesh);
+        batch_push(
+            &batch, t->glyph->tex, t->glyph->uv,
+            bk->body2world, m, mesh
+        );
+        num++;
+        de_view_next(&v);
+    }
+    return num;
+}
 
-    _shutdown(st);
+static Rectangle baked_bounds(de_ecs *r) {
+    cpBB bb = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+    de_view v = de_create_view(
+        r, 2, (de_cp_type[2]) { comp_baked, comp_mesh }
+    );
+    while (de_view_valid(&v)) {
+        struct Component_Baked *bk = de_view_get(&v, comp_baked);
+        struct Component_Mesh *mesh = de_view_get(&v, comp_mesh);
+        for (int i = 0; i < mesh->verts_num; i++)
+            bb = cpBBExpand(
+                bb, cpTransformPoint(bk->body2world, mesh->verts[i])
+            );
+        de_view_next(&v);
+    }
+    if (bb.l > bb.r)
+        return (Rectangle) {0};
+    return (Rectangle) {
+        floorf(bb.l), floorf(bb.b),
+        ceilf(bb.r - floorf(bb.l)), ceilf(bb.t - floorf(bb.b)),
+    };
+}
 
-    UnloadFont(fnt);
-    UnloadShader(shdr_mask);
-    UnloadTexture(tex_example);
+// Перерисовывает текстуру слоя, если ядро запекало или возвращало куски.
+// Вызывается до BeginMode2D().
+static void static_layer_update(SplitterCore *core) {
+    if (layer.version == core->baked_version)
+        return;
+    layer.version = core->baked_version;
+
+    layer.bounds = baked_bounds(core->r);
+    int w = layer.bounds.width, h = layer.bounds.height;
+    layer.direct = w > STATIC_LAYER_MAX_SIZE || h > STATIC_LAYER_MAX_SIZE;
+    if (!w || !h || layer.direct)
+        return;
+
+    if (layer.tex.texture.width != w || layer.tex.texture.height != h) {
+        if (layer.tex.id)
+            UnloadRenderTexture(layer.tex);
+        layer.tex = LoadRenderTexture(w, h);
+        LOG_DEBUG("static_layer_update: %dx%d\n", w, h);
+    }
+
+    BeginTextureMode(layer.tex);
+    ClearBackground(BLANK);
+    BeginMode2D((Camera2D) {
+        .target = { layer.bounds.x, layer.bounds.y },
+        .zoom = 1.,
+    });
+    draw_zoom = 1.;
+    push_baked(core->r);
+    batch_flush();
+    EndMode2D();
+    EndTextureMode();
+}
+
+static void static_layer_draw(SplitterCore *core) {
+    if (!is_show_textures || !layer.bounds.width)
+        return;
+    if (layer.direct) {
+        push_baked(core->r);
+        batch_flush();
+        return;
+    }
+    Rectangle src = { 0, 0, layer.bounds.width, -layer.bounds.height };
+    DrawTextureRec(
+        layer.tex.texture, src,
+        (Vector2) { layer.bounds.x, layer.bounds.y }, WHITE
+    );
+}
+
+static void static_layer_shutdown(void) {
+    if (layer.tex.id)
+        UnloadRenderTexture(layer.tex);
+    memset(&layer, 0, sizeof(layer));
+}
+
+// Частицы всегда рисуются пакетом, шейдера маски на каждую нет.
+static void draw_particles(SplitterCore *core) {
+    if (!is_show_textures)
+        return;
+    de_ecs *r = core->r;
+    const struct SimClock *c = &core->clock;
+    cpFloat back = (1. - c->alpha) * c->step;
+    for (int i = 0; i < core->particles_num; i++) {
+        const struct Particle *pt = &core->particles[i];
+        struct Component_Textured *t = de_try_get(r, pt->e, comp_textured);
+        struct Component_Mask *m = de_try_get(r, pt->e, comp_mask);
+        struct Component_Mesh *mesh = de_try_get(r, pt->e, comp_mesh);
+        if (!t || !m || !mesh)
+            continue;
+        batch_push(
+            &batch, t->glyph->tex, t->glyph->uv,
+            particle_transform_back(pt, back), m, mesh
+        );
+    }
+    batch_flush();
 }
 
-void draw_chars(de_ecs *r, de_entity *ennts, int entts_num) {
+// alpha - доля шага симуляции для интерполяции, см. SimClock
+void draw_chars(de_ecs *r, double alpha) {
+    if (use_batch && is_show_textures) {
+        draw_chars_batched(r, alpha);
+        return;
+    }
+
     de_view view = de_create_view(
-        r, 2, (de_cp_type[2]) { comp_body, comp_textured }
+        r, 3, (de_cp_type[3]) { comp_body, comp_textured, comp_mask }
     );
     while (de_view_valid(&view)) {
         struct Component_Body *b = de_view_get(&view, comp_body);
         struct Component_Textured *t = de_view_get(&view, comp_textured);
+        struct Component_Mask *m = de_view_get(&view, comp_mask);
+        Texture2D tex = t->glyph->tex;
+        Rectangle src = t->glyph->src;
+
+        // Положение и поворот центра глифа в мире
+        cpTransform glyph2world = cpTransformMult(
+            core_body_transform(b, alpha), m->tr
+        );
 
-        Rectangle src = {
-            0, 0, 
-            t->tex.texture.width,
-            -t->tex.texture.height,
-        };
         Rectangle dst = {
-            b->b->p.x,
-            b->b->p.y,
-            t->tex.texture.width,
-            t->tex.texture.height,
+            glyph2world.tx,
+            glyph2world.ty,
+            m->size.x,
+            m->size.y,
         };
         Vector2 origin = {
-            t->tex.texture.width / 2.,
-            t->tex.texture.height / 2.,
+            dst.width / 2.,
+            dst.height / 2.,
         };
+        float angle = atan2(glyph2world.b, glyph2world.a);
 
-        if (is_show_textures && t->mask.texture.id && t->tex.texture.id) {
-            SetShaderValueTexture(shdr_mask, loc_mask_tex, t->mask.texture);
+        if (is_show_textures && tex.id) {
+            set_mask_uniforms(m, t->glyph);
             BeginShaderMode(shdr_mask);
             render_texture_t(
-                t->tex.texture, src, dst, origin, RAD2DEG * b->b->a,
-                WHITE, t->tr
+                tex, src, dst, origin, RAD2DEG * angle,
+                WHITE, cpTransformIdentity
             );
             EndShaderMode();
         }
-        DrawCircle(b->b->p.x, b->b->p.y, 10, BLUE);
+        draw_body_center(b, alpha);
 
         de_view_next(&view);
     }
 
 }
 
+// Сверху текстура глифа, снизу она же с маской куска.
 static void debug_draw_textures_and_masks(de_ecs *r, Vector2 start_point) {
     const float thick = 4.;
 
     Vector2 point = start_point;
-    de_view_single v = de_create_view_single(r, comp_textured);
-    while (de_view_single_valid(&v)) {
-        struct Component_Textured *t = de_view_single_get(&v);
-        DrawTexture(t->tex.texture, point.x, point.y, WHITE);
+    de_view v = de_create_view(
+        r, 2, (de_cp_type[2]) { comp_textured, comp_mask }
+    );
+    while (de_view_valid(&v)) {
+        struct Component_Textured *t = de_view_get(&v, comp_textured);
+        struct Component_Mask *m = de_view_get(&v, comp_mask);
+        Texture2D tex = t->glyph->tex;
+        Rectangle src = t->glyph->src;
+        float w = m->size.x, h = m->size.y;
+
+        DrawTexturePro(
+            tex, src, (Rectangle) { point.x, point.y, w, h },
+            Vector2Zero(), 0., WHITE
+        );
         DrawRectangleLinesEx(
             (Rectangle) {
-                point.x, point.y, t->tex.texture.width, t->tex.texture.height,
+                point.x, point.y, w, h,
             },
             thick, BLUE
         );
-        DrawTexture(
-            t->mask.texture,
-            point.x,
-            point.y + t->tex.texture.height,
-            WHITE
+
+        set_mask_uniforms(m, t->glyph);
+        BeginShaderMode(shdr_mask);
+        DrawTexturePro(
+            tex, src, (Rectangle) { point.x, point.y + h, w, h },
+            Vector2Zero(), 0., WHITE
         );
+        EndShaderMode();
         DrawRectangleLinesEx(
             (Rectangle) {
-                point.x, point.y + t->tex.texture.height,
-                t->tex.texture.width, t->tex.texture.height,
+                point.x, point.y + h,
+                w, h,
             },
             thick, BLUE
         );
 
-        point.x += t->tex.texture.width + thick;
+        point.x += w + thick;
+
+        de_view_next(&v);
+    }
+}
 
-        de_view_single_next(&v);
+// Триангуляция кусков поверх текстур
+static void debug_draw_meshes(de_ecs *r, double alpha) {
+    de_view v = de_create_view(
+        r, 2, (de_cp_type[2]) { comp_body, comp_mesh }
+    );
+    while (de_view_valid(&v)) {
+        struct Component_Body *b = de_view_get(&v, comp_body);
+        struct Component_Mesh *mesh = de_view_get(&v, comp_mesh);
+        cpTransform body2world = core_body_transform(b, alpha);
+        for (int i = 0; i < mesh->tris_num; i++) {
+            Vector2 tri[3];
+            for (int j = 0; j < 3; j++)
+                tri[j] = from_Vect(cpTransformPoint(
+                    body2world, mesh->verts[mesh->indices[i * 3 + j]]
+                ));
+            DrawLineV(tri[0], tri[1], GREEN);
+            DrawLineV(tri[1], tri[2], GREEN);
+            DrawLineV(tri[2], tri[0], GREEN);
+        }
+        de_view_next(&v);
     }
 }
 
 void slice_draw() {
     const float thick = 4.;
 
-    if(!IsMouseButtonDown(MOUSE_BUTTON_LEFT))
+    if(!IsMouseButtonDown(MOUSE_BUTTON_LEFT) || !swipe_num)
         return;
 
+    for (int i = 0; i + 1 < swipe_num; i++)
+        DrawLineEx(from_Vect(swipe[i]), from_Vect(swipe[i + 1]), thick, RED);
+
     DrawLineEx(
-        from_Vect(sliceStart), 
+        from_Vect(swipe[swipe_num - 1]), 
         GetScreenToWorld2D(GetMousePosition(), cam),
         thick, RED
     );
@@ -762,15 +1036,28 @@ static void example_draw() {
 
 void splitter_draw(Stage_Splitter *st) {
     //trace("splitter_draw:\n");
+    PROF_BEGIN(PROF_DRAW);
+    static_layer_update(&st->core);
     BeginDrawing();
     ClearBackground(BLACK);
     BeginMode2D(cam);
-
-    draw_chars(st->r, st->polygons, st->polygon_num);
-    debug_draw_textures_and_masks(st->r, (Vector2) { -2000, -1100, });
-
-    if (st->space)
-        space_debug_draw(st->space, WHITE);
+    draw_zoom = cam.zoom;
+
+    static_layer_draw(&st->core);
+    PROF_BEGIN(PROF_DRAW_CHARS);
+    draw_chars(st->core.r, st->core.clock.alpha);
+    PROF_END(PROF_DRAW_CHARS);
+    draw_particles(&st->core);
+    PROF_BEGIN(PROF_DRAW_TEXTURES_MASKS);
+    debug_draw_textures_and_masks(st->core.r, (Vector2) { -2000, -1100, });
+    PROF_END(PROF_DRAW_TEXTURES_MASKS);
+
+    PROF_BEGIN(PROF_SPACE_DEBUG_DRAW);
+    if (st->core.space)
+        space_debug_draw(st->core.space, WHITE);
+    PROF_END(PROF_SPACE_DEBUG_DRAW);
+    if (is_show_meshes)
+        debug_draw_meshes(st->core.r, st->core.clock.alpha);
 
     slice_draw();
     EndMode2D();
@@ -784,15 +1071,91 @@ void splitter_draw(Stage_Splitter *st) {
     //console_buf_write_c(WHITE, "sliceStart %s", cpVect_tostr(sliceStart));
     console_write("sliceStart %s", cpVect_tostr(sliceStart));
     console_write("cam %s", camera2str(cam));
+    if (use_batch)
+        console_write(
+            "batch: textures %d fragments %d triangles %d",
+            batch.stats.textures, batch.stats.fragments, batch.stats.triangles
+        );
+    console_write(
+        "fragments: %d of %d (%s), evicted %lu",
+        core_fragment_count(&st->core), budget.max_fragments,
+        evict_policy2str(budget.policy),
+        (unsigned long)st->core.stats.fragments_evicted
+    );
+    console_write(
+        "particles: %d, min area %.0f",
+        core_particle_count(&st->core), particle_min_area
+    );
+    if (bake_enabled)
+        console_write(
+            "baked: %d, layer %.0fx%.0f%s",
+            core_baked_count(&st->core),
+            layer.bounds.width, layer.bounds.height,
+            layer.direct ? " direct" : ""
+        );
+    struct BroadphaseState *bs = &st->core.broadphase_state;
+    if (bs->type == BROADPHASE_HASH)
+        console_write(
+            "broadphase: hash dim %.0f count %d rebuilds %lu",
+            bs->dim, bs->count, (unsigned long)bs->rebuilds
+        );
+    else
+        console_write("broadphase: bbtree");
+    console_write(
+        "clock: steps %lu capped frames %lu alpha %.2f",
+        (unsigned long)st->core.clock.steps,
+        (unsigned long)st->core.clock.frames_capped, st->core.clock.alpha
+    );
+    console_write(
+        "threads: physics %d slices %d",
+        core_step_threads(&st->core), slice_threads
+    );
+    console_write(
+        "glyphs: strings %d pages %d overflow %d %zu KB hits %lu misses %lu%s",
+        glyphs.stats.strings, glyphs.stats.pages, glyphs.stats.overflow,
+        glyphs.stats.bytes / 1024,
+        (unsigned long)glyphs.stats.hits, (unsigned long)glyphs.stats.misses,
+        glyphs.sdf ? " sdf" : ""
+    );
+    struct LogStats ls = log_stats();
+    console_write(
+        "log: written %lu dropped %lu",
+        (unsigned long)ls.written, (unsigned long)ls.dropped
+    );
+    struct FragmentPoolStats *ps = &st->core.pool.stats;
+    console_write(
+        "pool: live %zu KB free %zu KB heap allocs %lu",
+        ps->bytes_live / 1024, ps->bytes_free / 1024,
+        (unsigned long)pool_heap_allocs(&st->core.pool)
+    );
+    if (dump_is_enabled()) {
+        struct DumpStats ds = dump_stats();
+        console_write(
+            "dump: written %lu dropped %lu queued %d",
+            (unsigned long)ds.written, (unsigned long)ds.dropped, ds.queued
+        );
+    }
+#ifdef SPLITTER_PROFILE
+    // Шаг включает post-step, post-step включает update_mask
+    for (int i = 0; i < PROF_PHASES_NUM; i++) {
+        struct ProfStats ps = prof_stats(i);
+        console_write(
+            "prof %-19s min %6.3f avg %6.3f p99 %6.3f ms",
+            prof_phase2str(i), ps.min, ps.avg, ps.p99
+        );
+    }
+#endif
 
     example_draw();
 
+    PROF_END(PROF_DRAW);
     EndDrawing();
+    PROF_FRAME();
 }
 
 void splitter_reset(Stage_Splitter *st) {
     _shutdown(st);
-    _init(st);
+    _start(st);
 }
 
 static void camera_process_mouse_wheel(Camera2D *cam) {
@@ -807,33 +1170,9 @@ static void camera_process_mouse_wheel(Camera2D *cam) {
     cam->zoom = cam->zoom < dzoom ? dzoom : cam->zoom;
 }
 
-static void xxx_draw_slice(void *udata) {
-    struct SliceContext *ctx = udata;
-    DrawLineV(from_Vect(ctx->a), from_Vect(ctx->b), BLUE);
-}
-
-static void slice(cpSpace *space, cpVect from, cpVect to) {
-    struct SliceContext *context = malloc(sizeof(*context));
-    context->a = from;
-    context->b = to;
-    context->space = space;
-
-    dev_draw_push(xxx_draw_slice, context, sizeof(*context));
-    trace(
-        "splitter_update: from %s to %s\n",
-        cpVect_tostr(context->a),
-        cpVect_tostr(context->b)
-    );
-
-    cpSpaceSegmentQuery(
-        space, from, to, 0.0, GRAB_FILTER, 
-        (cpSpaceSegmentQueryFunc)SliceQuery, context
-    );
-
-}
-
 void splitter_update(Stage_Splitter *st) {
     /*trace("splitter_update:\n");*/
+    PROF_BEGIN(PROF_UPDATE);
     if (IsKeyPressed(KEY_ESCAPE)) {
         CloseWindow();
     }
@@ -856,23 +1195,60 @@ void splitter_update(Stage_Splitter *st) {
             use_gravity ? "false" : "true"
         );
         if (use_gravity)
-            cpSpaceSetGravity(st->space, gravity);
+            cpSpaceSetGravity(st->core.space, gravity);
         else
-            cpSpaceSetGravity(st->space, cpvzero);
+            cpSpaceSetGravity(st->core.space, cpvzero);
+        cpVect g = cpSpaceGetGravity(st->core.space);
+        replay_record(
+            &recorder, st->core.clock.steps, REPLAY_GRAVITY, &g, sizeof(g)
+        );
     }
 
     if (IsKeyPressed(KEY_P))
         is_paused = !is_paused;
 
-    if (st->space && !is_paused) cpSpaceStep(st->space, 1. / 60);
-    //cpSpaceStep(st->space, GetFrameTime());
+    st->core.budget = budget;
+    st->core.broadphase = broadphase;
+    st->core.lod.min_area = particle_min_area;
+    st->core.bake.enabled = bake_enabled;
+    if (slice_threads_dirty) {
+        core_set_slice_threads(&st->core, slice_threads);
+        slice_threads_dirty = false;
+    }
+    if (step_threads_dirty) {
+        core_set_step_threads(&st->core, step_threads);
+        step_threads_dirty = false;
+    }
+    if (use_sdf_dirty) {
+        _shutdown(st);
+        glyph_cache_shutdown(&glyphs);
+        glyph_cache_init(&glyphs, fnt, fnt.baseSize, use_sdf);
+        _start(st);
+        use_sdf_dirty = false;
+    }
+    if (snapshot_save_path[0]) {
+        snapshot_save(&st->core, snapshot_save_path, snapshot_tag, NULL);
+        snapshot_save_path[0] = 0;
+    }
+    if (snapshot_pending) {
+        double time_start = GetTime();
+        _shutdown(st);
+        _start(st);
+        snapshot_pending = false;
+        trace(
+            "splitter_update: snapshot restored in %.3f ms\n",
+            (GetTime() - time_start) * 1000.
+        );
+    }
+    replay_record_opts(&recorder, &st->core);
+    if (!is_paused) core_advance(&st->core, GetFrameTime());
     
     if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) {
-        int ch = random() % 26;
+        int ch = replay_rand(&rng) % 26;
         char input[2] = {0};
         input[0] = 'A' + ch;
-        create_char(
-            st->space, st->r, input, 
+        spawn_char(
+            &st->core, input, 
             GetScreenToWorld2D(GetMousePosition(), cam)
         );
     }
@@ -882,27 +1258,39 @@ void splitter_update(Stage_Splitter *st) {
 
     // Annoying state tracking code that you wouldn't need
     // in a real event driven system.
+    Vector2 world_pos = GetScreenToWorld2D(GetMousePosition(), cam);
+    cpVect mouse_pos = from_Vector2(world_pos);
+
     if(IsMouseButtonDown(MOUSE_BUTTON_LEFT) != lastClickState){
         if(IsMouseButtonDown(MOUSE_BUTTON_LEFT)){
-            Vector2 world_pos = GetScreenToWorld2D(GetMousePosition(), cam);
-            sliceStart = from_Vector2(world_pos);
+            sliceStart = mouse_pos;
+            swipe_num = 0;
+            swipe[swipe_num++] = mouse_pos;
         } else {
-            Vector2 world_pos = GetScreenToWorld2D(GetMousePosition(), cam);
-            cpVect mouse_pos = from_Vector2(world_pos);
-            slice(st->space, sliceStart, mouse_pos);
+            // Последняя ячейка всегда остается под конечную точку
+            swipe[swipe_num++] = mouse_pos;
+            replay_record(
+                &recorder, st->core.clock.steps, REPLAY_SLICE,
+                swipe, sizeof(swipe[0]) * swipe_num
+            );
+            core_slice_polyline(&st->core, swipe, swipe_num);
+            swipe_num = 0;
         }
 
         lastClickState = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
+    } else if (lastClickState && swipe_num < MAX_SWIPE_POINTS - 1) {
+        if (cpvdist(mouse_pos, swipe[swipe_num - 1]) > swipe_step)
+            swipe[swipe_num++] = mouse_pos;
     }
 
     //trace("splitter_update: sliceStart %s\n", cpVect_tostr(sliceStart));
+    PROF_END(PROF_UPDATE);
 }
 
 void on_destroy_textured(void *payload, de_entity e) {
     assert(payload);
     struct Component_Textured *t = payload;
-    UnloadRenderTexture(t->tex);
-    UnloadRenderTexture(t->mask);
+    glyph_unref(t->glyph);
 }
 
 Stage *stage_splitter_new() {
@@ -917,39 +1305,47 @@ Stage *stage_splitter_new() {
 
 void stage_splitter_test() {
 #if 1
-    cpSpace *space = cpSpaceNew();
-
-    de_ecs *ecs = de_ecs_make();
+    SplitterCore core = {0};
+    core_init(&core);
+    de_ecs *ecs = core.r;
 
     {
-        de_entity e = create_char(space, ecs, "HUI", (Vector2) { 100, 100});
+        de_entity e = create_char(&core, "HUI", (Vector2) { 100, 100});
         struct Component_Textured *t = de_try_get(ecs, e, comp_textured);
         struct Component_Body *b = de_try_get(ecs, e, comp_body);
+        struct Component_Mask *m = de_try_get(ecs, e, comp_mask);
         assert(t);
         assert(b);
-        render_contour(&t->mask, b->b);
+        assert(m);
+        assert(m->planes.num == 0);
+
+        core_diagonal_slice(&core, e);
+        core_step(&core, 1. / 60);
+
+        // Центр масс каждого куска должен оказаться внутри его маски
+        de_view v = de_create_view(
+            ecs, 2, (de_cp_type[2]) { comp_body, comp_mask }
+        );
+        while (de_view_valid(&v)) {
+            struct Component_Mask *m = de_view_get(&v, comp_mask);
+            cpVect center = cpTransformPoint(
+                cpTransformInverse(m->tr), cpvzero
+            );
+            assert(m->planes.num == 1);
+            assert(planes_contains(&m->planes, center));
+            de_view_next(&v);
+        }
     }
 
     {
-        de_entity e = create_char(space, ecs, "HUI", (Vector2) { 100, 100});
+        de_entity e = create_char(&core, "HUI", (Vector2) { 100, 100});
         struct Component_Textured *t = de_try_get(ecs, e, comp_textured);
         struct Component_Body *b = de_try_get(ecs, e, comp_body);
         cpBodyAddShape(b->b, make_circle_polyshape(b->b, 40., NULL));
         assert(t);
         assert(b);
-        render_contour(&t->mask, b->b);
     }
 
-
-    de_ecs_destroy(ecs);
-
-    space_shutdown((struct SpaceShutdownCtx) {
-        .space = space, 
-        .free_bodies = true, 
-        .free_shapes = true,
-        .free_constraints = true,
-    });
-    cpSpaceFree(space);
+    core_shutdown(&core);
 #endif
 }
-
@@ -3,9 +3,16 @@
 #include "koh_hotkey.h"
 #include "koh_stages.h"
 #include "koh_hotkey.h"
+#include <stdint.h>
 
 struct SplitterCtx {
     HotkeyStorage *hk_store;
+    // Потоки решателя из командной строки, -1 - по умолчанию
+    int           step_threads;
+    // --record FILE - журнал действий для splitter_bench replay
+    const char    *record_path;
+    // --seed N - зерно выбора глифов, 0 - по умолчанию
+    uint64_t      seed;
 };
 
 Stage *stage_splitter_new();
@@ -0,0 +1,27 @@
+// Сборка файла атласа шрифта заранее, окно не создается.
+//
+// ./gen_atlas [ttf] [size] [atlas] [chars]
+//
+// Без аргументов собирает атлас, который splitter ищет при запуске.
+
+#include "koh_logger.h"
+#include "splitter_atlas.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    const char *ttf = argc > 1 ? argv[1] : SPLITTER_FONT_TTF;
+    int size = argc > 2 ? atoi(argv[2]) : SPLITTER_FONT_SIZE;
+    const char *atlas = argc > 3 ? argv[3] : SPLITTER_FONT_ATLAS;
+    const char *chars = argc > 4 ? argv[4] : SPLITTER_FONT_CHARS;
+    if (size <= 0) {
+        fprintf(stderr, "gen_atlas: bad font size\n");
+        return EXIT_FAILURE;
+    }
+
+    logger_init();
+    bool ok = atlas_build(ttf, atlas, size, chars);
+    printf("gen_atlas: %s -> %s %s\n", ttf, atlas, ok ? "ok" : "failed");
+    logger_shutdown();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}